@@ -11,6 +11,10 @@
 
 #include "3d_filled_vector.h"
 
+#if MESHFILES == 1
+#include "fatfs.h"
+#endif
+
 /* BSP_LCD_... */
 #include "stm32_adafruit_lcd_fb.h"
 
@@ -176,7 +180,7 @@ int handleButton()
 
 // --------------------------------------------------------------------------
 char txt[30];
-#define MAX_OBJ 12
+#define MAX_OBJ 14
 int bgMode = 3;
 int object = 6;
 int bfCull = 1;
@@ -187,6 +191,11 @@ int polyMode = 0;
 #include "pat7.h"
 #include "pat8.h"
 #include "gfx3d.h"
+#if MESHFILES == 1
+#include "mesh3d.h"
+#else
+#define numMeshFiles 0
+#endif
 
 void setup() 
 {
@@ -211,7 +220,17 @@ void setup()
   }
 
   BSP_LCD_Clear(LCD_COLOR_BLACK);
+  #ifdef DWT
+  /* cycle counter of the transform time (transCycles) */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  #endif
   initStars();
+  #if MESHFILES == 1
+  meshScan();
+  #endif
 }
 
 unsigned int ms, msMin = 1000, msMax = 0, stats = 1, optim = 0; // optim=1 for ST7735, 0 for ST7789
@@ -223,13 +242,16 @@ void showStats()
   BSP_LCD_SetBackColor(LCD_COLOR_BLACK);
   if(optim == 0)
   {
-    snprintf(txt, 30, "%d ms     %d fps ", ms, 1000 / ms);
+    snprintf(txt, 30, "%d ms  %d fps  %d clk/v   ", ms, 1000 / ms, numVerts ? (int)(transCycles / numVerts) : 0);
     BSP_LCD_SetTextColor(LCD_COLOR_YELLOW);
     BSP_LCD_DisplayStringAt(0, SCR_HT - 3 * CHARSIZEY, (uint8_t *)txt, LEFT_MODE);
     snprintf(txt, 30, "%d-%d ms  %d-%d fps   ", msMin, msMax, 1000 / msMax, 1000 / msMin);
     BSP_LCD_SetTextColor(LCD_COLOR_GREEN);
     BSP_LCD_DisplayStringAt(0, SCR_HT - 2 * CHARSIZEY, (uint8_t *)txt, LEFT_MODE);
-    snprintf(txt, 30, "total/vis %d / %d   ", numPolys, numVisible);
+    if(meshFail)
+      snprintf(txt, 30, "out of memory       ");
+    else
+      snprintf(txt, 30, "total/vis %d / %d   ", numPolys, numVisible);
     BSP_LCD_SetTextColor(LCD_COLOR_MAGENTA);
     BSP_LCD_DisplayStringAt(0, SCR_HT - CHARSIZEY, (uint8_t *)txt, LEFT_MODE);
   }
@@ -258,7 +280,10 @@ void showStats()
     BSP_LCD_DisplayStringAt(0, SCR_HT - 2 * CHARSIZEY, (uint8_t *)txt, LEFT_MODE);
     snprintf(txt, 30, "%2d-%2d", 1000 / msMax, 1000 / msMin);
     BSP_LCD_DisplayStringAt(10 * CHARSIZEX, SCR_HT - 2 * CHARSIZEY, (uint8_t *)txt, LEFT_MODE);
-    snprintf(txt, 30, "%3d", numPolys);
+    if(meshFail)
+      snprintf(txt, 30, "mem");
+    else
+      snprintf(txt, 30, "%3d", numPolys);
     BSP_LCD_SetTextColor(LCD_COLOR_MAGENTA);
     BSP_LCD_DisplayStringAt(10 * CHARSIZEX, SCR_HT - CHARSIZEY, (uint8_t *)txt, LEFT_MODE);
     snprintf(txt, 30, "%3d", numVisible);
@@ -284,7 +309,7 @@ void loop()
   }
   else if(buttonState > 0)
   {
-    if(++object > MAX_OBJ)
+    if(++object > MAX_OBJ + numMeshFiles)
       object = 0;
     msMin = 1000;
     msMax = 0;
@@ -293,55 +318,59 @@ void loop()
   orient = 0;
   bfCull = 1;
   lightShade = 0;
+  triShade = 18000;
+  gouraud = 0;
+  texture = 0;
+  meshNormals = 0;
   switch(object)
   {
     case 0:
       numVerts  = numVertsCubeQ;
       verts     = (int16_t*)vertsCubeQ;
       numPolys  = numQuadsCubeQ;
-      polys     = (uint8_t*)quadsCubeQ;
+      polys     = (uint16_t*)quadsCubeQ;
       polyColors = (uint16_t*)colsCubeQ;
       break;
     case 1:
       numVerts  = numVertsCubeQ;
       verts     = (int16_t*)vertsCubeQ;
       numPolys  = numQuadsCubeQ;
-      polys     = (uint8_t*)quadsCubeQ;
+      polys     = (uint16_t*)quadsCubeQ;
       lightShade = 44000;
       break;
    case 2:
       numVerts  = numVertsCross;
       verts     = (int16_t*)vertsCross;
       numPolys  = numQuadsCross;
-      polys     = (uint8_t*)quadsCross;
+      polys     = (uint16_t*)quadsCross;
       polyColors = (uint16_t*)colsCross;
       break;
    case 3:
       numVerts  = numVertsCross;
       verts     = (int16_t*)vertsCross;
       numPolys  = numQuadsCross;
-      polys     = (uint8_t*)quadsCross;
+      polys     = (uint16_t*)quadsCross;
       lightShade = 14000;
       break;
    case 4:
       numVerts  = numVerts3;
       verts     = (int16_t*)verts3;
       numPolys  = numQuads3;
-      polys     = (uint8_t*)quads3;
+      polys     = (uint16_t*)quads3;
       polyColors = (uint16_t*)cols3;
       break;
    case 5:
       numVerts  = numVerts3;
       verts     = (int16_t*)verts3;
       numPolys  = numQuads3;
-      polys     = (uint8_t*)quads3;
+      polys     = (uint16_t*)quads3;
       lightShade = 20000;
       break;
    case 6:
       numVerts  = numVertsCubes;
       verts     = (int16_t*)vertsCubes;
       numPolys  = numQuadsCubes;
-      polys     = (uint8_t*)quadsCubes;
+      polys     = (uint16_t*)quadsCubes;
       polyColors = (uint16_t*)colsCubes;
       bfCull    = 0;
       break;
@@ -349,7 +378,7 @@ void loop()
       numVerts  = numVertsCubes;
       verts     = (int16_t*)vertsCubes;
       numPolys  = numQuadsCubes;
-      polys     = (uint8_t*)quadsCubes;
+      polys     = (uint16_t*)quadsCubes;
       bfCull    = 1;
       lightShade = 14000;
       break;
@@ -357,7 +386,7 @@ void loop()
       numVerts  = numVertsCone;
       verts     = (int16_t*)vertsCone;
       numPolys  = numTrisCone;
-      polys     = (uint8_t*)trisCone;
+      polys     = (uint16_t*)trisCone;
       polyColors = (uint16_t*)colsCone;
       bfCull    = 1;
       orient    = 1;
@@ -367,9 +396,10 @@ void loop()
       numVerts  = numVertsSphere;
       verts     = (int16_t*)vertsSphere;
       numPolys  = numTrisSphere;
-      polys     = (uint8_t*)trisSphere;
+      polys     = (uint16_t*)trisSphere;
       //polyColors = (uint16_t*)colsSphere;
       lightShade = 58000;
+      gouraud   = 1;
       bfCull    = 1;
       orient    = 1;
       polyMode  = 1;
@@ -378,7 +408,7 @@ void loop()
       numVerts  = numVertsTorus;
       verts     = (int16_t*)vertsTorus;
       numPolys  = numTrisTorus;
-      polys     = (uint8_t*)trisTorus;
+      polys     = (uint16_t*)trisTorus;
       polyColors = (uint16_t*)colsTorus;
       bfCull    = 1;
       orient    = 1;
@@ -388,8 +418,9 @@ void loop()
       numVerts  = numVertsTorus;
       verts     = (int16_t*)vertsTorus;
       numPolys  = numTrisTorus;
-      polys     = (uint8_t*)trisTorus;
+      polys     = (uint16_t*)trisTorus;
       lightShade = 20000;
+      gouraud   = 1;
       bfCull    = 1;
       orient    = 1;
       polyMode  = 1;
@@ -398,19 +429,45 @@ void loop()
       numVerts  = numVertsMonkey;
       verts     = (int16_t*)vertsMonkey;
       numPolys  = numTrisMonkey;
-      polys     = (uint8_t*)trisMonkey;
+      polys     = (uint16_t*)trisMonkey;
       //polyColors = (uint16_t*)colsMonkey;
       lightShade = 20000;
+      gouraud   = 1;
+      bfCull    = 1;
+      orient    = 1;
+      polyMode  = 1;
+      break;
+   case 13:
+      numVerts  = numVertsCubeQ;
+      verts     = (int16_t*)vertsCubeQ;
+      numPolys  = numQuadsCubeQ;
+      polys     = (uint16_t*)quadsCubeQ;
+      polyColors = (uint16_t*)colsCubeQ;
+      texture   = &pat8[3];
+      break;
+   case 14:
+      numVerts  = numVertsTorus;
+      verts     = (int16_t*)vertsTorus;
+      numPolys  = numTrisTorus;
+      polys     = (uint16_t*)trisTorus;
+      polyColors = (uint16_t*)colsTorus;
+      texture   = &pat2[3];
       bfCull    = 1;
       orient    = 1;
       polyMode  = 1;
       break;
+   #if MESHFILES == 1
+   default:
+      meshSelect(object - MAX_OBJ - 1);  // mesh files from the SD card
+      break;
+   #endif
   }
   ms = GetTime();
   render3D(polyMode);
   ms = GetTime() - ms;
   if(stats)
     showStats();
+  BSP_LCD_SwapBuffers();  /* if LCD_BUFFERS > 1 */
 }
 
 //-----------------------------------------------------------------------------
@@ -24,6 +24,33 @@
    - 1 Double buffer enabled */
 #define DOUBLEBUF 1
 
+/* Strip Z-buffer (WD_3D * NLINES * 2 bytes from the D2 ram heap)
+   - 0 Z-buffer disabled (painter's algorithm, far polygons drawn first)
+   - 1 Z-buffer enabled (per pixel depth test, intersecting polygons are drawn correctly,
+       polygons drawn front to back) */
+#define ZBUFFER   0
+
+/* Texture cache (the active 32x32 texture is copied to the DTCM ram, 2 kbytes)
+   - 0 texels read from the flash
+   - 1 texels read from the DTCM ram */
+#define TEXCACHE  1
+
+/* Projection scale table (the D-cache is off, a table read from the D2 ram may be slower than the
+   hardware divider: compare the cycles of the stats line)
+   - 0 one division per vertex
+   - 1 scale of the vertex distances 1..2047 from a table (D2 ram heap, 8 kbytes) */
+#define RECIPTAB  0
+
+/* Mesh files (*.m3d, see mesh3d.h) from the SD card, shown after the built-in objects
+   - 0 built-in objects only
+   - 1 mesh files from the MESHFOLDER of the SD card (FatFs) */
+#define MESHFILES  1
+/* Mesh file folder of the SD card and the max. number of files */
+#define MESHFOLDER "3d/"
+#define MESHMAX    16
+/* Mesh file read chunk size (bytes) */
+#define MESHCHUNK  4096
+
 /* Button pin assign */
 #define BUTTON    C, 5    /* If not used leave it that way */
 /* Button active level (0 or 1) */
@@ -4,20 +4,27 @@
 /*
  Implemented features:
  - optimized rendering without local framebuffer, in STM32 case 1 to 32 lines buffer can be used
+ - polygons binned by strips once per frame, edge walk starts at the strip's first row
+ - fixed point DDA edges (one step per scanline)
+ - optional strip Z-buffer (ZBUFFER)
+ - texture mapped polygons (perspective corrected every TEXSUB pixels)
  - pattern based background
  - 3D starfield
  - no floating point arithmetic
  - no slow trigonometric functions
- - rotations around X and Y axes
+ - Q15 rotation matrix built once per frame (rotations around any axes in any order)
+ - vertex transform with packed 16 bit multiply-accumulate (SMLAD) on Cortex-M4/M7
+ - projection with one division per vertex and one 32 x 32 bit multiply per coordinate (RECIPTAB: scale table)
  - simple outside screen culling
  - rasterizer working for all convex polygons
  - backface culling
- - visible faces sorting by Z axis
+ - visible faces sorting by Z axis (linear time radix sort)
  - support for quads and triangles
+ - models with up to 32767 vertices / polygons (work arrays sized per model from the D2 ram heap)
  - optimized structures, saved some RAM and flash
  - added models
  - optimized stats displaying
- - fake light shading
+ - fake light shading (flat or Gouraud)
 */
 
 #define swap(a, b) {int t = a; a = b; b = t;}
@@ -62,6 +69,53 @@ int fastCos(int i)
   return fastSin(i + 90);
 }
 
+// Q15 sine for the rotation matrix
+#define Q15ONE 32767
+const int16_t sin15Tab[91] =
+{
+  0,572,1144,1715,2286,2856,3425,3993,4560,5126,5690,6252,6813,7371,7927,
+  8481,9032,9580,10126,10668,11207,11743,12275,12803,13328,13848,14364,14876,15383,15886,
+  16383,16876,17364,17846,18323,18794,19260,19720,20173,20621,21062,21497,21925,22347,22762,
+  23170,23571,23964,24351,24730,25101,25465,25821,26169,26509,26841,27165,27481,27788,28087,
+  28377,28659,28932,29196,29451,29697,29934,30162,30381,30591,30791,30982,31163,31335,31498,
+  31650,31794,31927,32051,32165,32269,32364,32448,32523,32587,32642,32687,32722,32747,32762,
+  32767
+};
+
+int fastSin15(int i)
+{
+  while(i < 0) i += 360;
+  while(i >= 360) i -= 360;
+  if(i < 90)
+    return(sin15Tab[i]);
+  else if(i < 180)
+    return(sin15Tab[180 - i]);
+  else if(i < 270)
+    return(-sin15Tab[i - 180]);
+  else
+    return(-sin15Tab[360 - i]);
+}
+
+int fastCos15(int i)
+{
+  return fastSin15(i + 90);
+}
+
+// the angle of |sin| and |cos| (like fastSin and fastCos): 0..90 and back, the swing of the demo models
+int swingAngle(int i)
+{
+  while(i < 0) i += 360;
+  while(i >= 360) i -= 360;
+  if(i < 90)
+    return i;
+  else if(i < 180)
+    return 180 - i;
+  else if(i < 270)
+    return i - 180;
+  else
+    return 360 - i;
+}
+
 // ------------------------------------------------
 
 #define COL11 LCD_COLOR(0,250,250)  // CYAN
@@ -102,98 +156,114 @@ int fastCos(int i)
 int16_t numVerts;
 int16_t *verts;
 int16_t numPolys;
-uint8_t *polys;
+uint16_t *polys;
 uint16_t *polyColors;
+const uint16_t *texture = 0;  // 32x32 texture of the polygons (pat*.h + 3), 0 = no texture
+const int8_t *meshNormals = 0; // unit vertex normals * 127 of the model (0 = calculated from the polygons)
+uint32_t meshSerial = 0;      // increment when new model data is loaded to the same address
 
-#define MAXVERTS 140
-#define MAXPOLYS 240
+// output arrays (allocated per model, see meshAlloc)
+int16_t *transVerts;
+int16_t *projVerts;
+int16_t *projW;  // perspective divisor of the vertices
+uint16_t *sortedPolys;
+uint32_t *normZ;  // |z| of the polygon normal (the flat shading, 32 bits: big quads)
 
-// output arrays
-int16_t transVerts[MAXVERTS * 3];
-int16_t projVerts[MAXVERTS * 2];
-uint16_t sortedPolys[MAXPOLYS];
-uint16_t normZ[MAXPOLYS];
-
-int rot0 = 0, rot1 = 0;
+int rot0 = 0, rot1 = 0, rot2 = 0;  // rotation around the Y, X and Z axes (degrees)
+int16_t rotM[9];                   // Q15 rotation matrix of the frame (row major)
 int numVisible = 0;
 int lightShade = 0;
+int triShade = 18000; // flat shading divisor of the triangles (lightShade: of the quads)
+int gouraud = 0;    // Gouraud shading with lightShade (smooth models)
+int meshFail = 0;   // the work arrays of the model do not fit in the D2 ram heap (it is not drawn)
 
-// simple Amiga like blitter implementation
-void rasterize(int x0, int y0, int x1, int y1, int16_t *line)
+// add x to the span of the row
+void spanX(int16_t *line, int x)
 {
-  if((y0 < yFr && y1 < yFr) || (y0 >= yFr + NLINES && y1 >= yFr + NLINES))
+  if(x < line[0])
+    line[0] = x > 0 ? x : 0;
+  if(x > line[1])
+    line[1] = x < WD_3D ? x : WD_3D - 1;
+}
+
+// 16.16 fixed point DDA edge walker (y0 <= y1, dxdy: x step per scanline from the per frame edge setup)
+// x is computed directly at the first row of the rasterized area, then stepped once per scanline until its last row
+void rasterize(int x0, int y0, int x1, int y1, int32_t dxdy, int16_t *line)
+{
+  int y = y0, x;
+  int yEnd = yFr + NLINES - 1;
+  if(y1 < yFr || y > yEnd)
     return; // exit if line outside rasterized area
-  int dx = abs(x1 - x0);
-  int dy = abs(y1 - y0);
-  int err2, err = dx - dy;
-  int sx = (x0 < x1) ? 1 : -1;
-  int sy = (y0 < y1) ? 1 : -1;
-  
-  while(1)
+  if(y == y1)
   {
-    if(y0 >= yFr && y0 < yFr + NLINES)
-    {
-      if(x0 < line[2 * (y0 - yFr) + 0])
-        line[2 * (y0 - yFr) + 0] = x0 > 0 ? x0 : 0;
-      if(x0 > line[2 * (y0 - yFr) + 1])
-        line[2 * (y0 - yFr) + 1] = x0 < WD_3D ? x0 : WD_3D - 1;
-    }
-
-    if(x0 == x1 && y0 == y1)
-      return;
-    err2 = err + err;
-    if(err2 > -dy)
-    {
-      err -= dy;
-      x0 += sx;
-    }
-    if(err2 < dx)
-    {
-      err += dx;
-      y0 += sy;
-    }
+    // horizontal edge: both endpoints on the same row
+    spanX(&line[2 * (y - yFr)], x0);
+    spanX(&line[2 * (y - yFr)], x1);
+    return;
   }
+  if(y < yFr)
+    y = yFr;
+  if(y1 > yEnd)
+    y1 = yEnd;
+  x = x0 * 65536 + 0x8000 + (y - y0) * dxdy;
+  for(; y <= y1; y++, x += dxdy)
+    spanX(&line[2 * (y - yFr)], x >> 16);
 }
 
-void drawQuad(int x0, int y0, int x1, int y1, int x2, int y2, int x3, int y3, uint16_t c)
+// depth sort work arrays (indexed by the polygon number)
+#define ZBUCKETS 256
+int *zPoly;
+uint16_t *tmpPolys;
+uint16_t zCount[ZBUCKETS];
+
+// one stable counting sort pass by the (zPoly >> sh) & 0xff digit
+void radixPass(uint16_t *src, uint16_t *dst, int sh)
 {
-  int x, y;
-  int16_t line[NLINES * 2];
-  for(y = 0; y < NLINES; y++)
+  int i, c, sum = 0;
+  memset(zCount, 0, sizeof(zCount));
+  for(i = 0; i < numVisible; i++)
+    zCount[(zPoly[src[i]] >> sh) & (ZBUCKETS - 1)]++;
+  for(i = 0; i < ZBUCKETS; i++)
   {
-    line[2 * y + 0] = WD_3D + 1;
-    line[2 * y + 1] = -1;
+    c = zCount[i];
+    zCount[i] = sum;
+    sum += c;
   }
-
-  rasterize(x0, y0, x1, y1, line);
-  rasterize(x1, y1, x2, y2, line);
-  rasterize(x2, y2, x3, y3, line);
-  rasterize(x3, y3, x0, y0, line);
-
-  for(y = 0; y < NLINES; y++)
-    if(line[2 * y + 1] > line[2 * y + 0])
-      for(x = line[2 * y + 0]; x <= line[2 * y + 1]; x++)
-        frBuf[SCR_WD * y + x] = c;
+  for(i = 0; i < numVisible; i++)
+    dst[zCount[(zPoly[src[i]] >> sh) & (ZBUCKETS - 1)]++] = src[i];
 }
 
-void drawTri(int x0, int y0, int x1, int y1, int x2, int y2, uint16_t c)
+// sort the visible polygons by Z (far first), nv = vertices per polygon
+// the key is the distance from the farthest Z sum quantized to 16 bits, sorted in two 8 bit radix passes
+void sortPolys(int16_t *v, int nv)
 {
-  int x, y;
-  int16_t line[NLINES * 2];
-  for(y=0; y < NLINES; y++)
+  int i, j, q, z, zMin = 0x7fffffff, zMax = -0x7fffffff, sh = 0;
+  // sum of Z of the polygon (average * nv)
+  for(i = 0; i < numVisible; ++i)
   {
-    line[2 * y + 0] = WD_3D + 1;
-    line[2 * y + 1] = -1;
+    q = sortedPolys[i];
+    z = 0;
+    for(j = 0; j < nv; ++j)
+      z += v[3 * polys[nv * q + j] + 2];
+    zPoly[q] = z;
+    if(z < zMin)
+      zMin = z;
+    if(z > zMax)
+      zMax = z;
   }
+  if(numVisible < 2)
+    return;
 
-  rasterize(x0, y0, x1, y1, line);
-  rasterize(x1, y1, x2, y2, line);
-  rasterize(x2, y2, x0, y0, line);
+  while(((zMax - zMin) >> sh) > 0xffff)
+    sh++;
+  for(i = 0; i < numVisible; ++i)
+  {
+    q = sortedPolys[i];
+    zPoly[q] = (zMax - zPoly[q]) >> sh;
+  }
 
-  for(y = 0; y < NLINES; y++)
-    if(line[2 * y + 1] > line[2 * y + 0])
-      for(x = line[2 * y + 0]; x <= line[2 * y + 1]; x++)
-        frBuf[SCR_WD * y + x] = c;
+  radixPass(sortedPolys, tmpPolys, 0);
+  radixPass(tmpPolys, sortedPolys, 8);
 }
 
 void cullQuads(int16_t *v)
@@ -221,27 +291,7 @@ void cullQuads(int16_t *v)
     //Serial.println(txt);
   }
   
-  int i, j, zPoly[numVisible];
-  // average Z of the polygon
-  for(i = 0; i < numVisible; ++i)
-  {
-    zPoly[i] = 0.0;
-    for(j = 0; j < 4; ++j)
-      zPoly[i] += v[3 * polys[4 * sortedPolys[i] + j] + 2];
-  }
-
-  // sort by Z
-  for(i = 0; i < numVisible - 1; ++i)
-  {
-    for(j = i; j < numVisible; ++j)
-    {
-      if(zPoly[i] < zPoly[j])
-      {
-        swap(zPoly[j], zPoly[i]);
-        swap(sortedPolys[j], sortedPolys[i]);
-      }
-    }
-  }
+  sortPolys(v, 4);
 }
 
 void cullTris(int16_t *v)
@@ -265,68 +315,583 @@ void cullTris(int16_t *v)
       sortedPolys[numVisible++] = i;
   }
 
-  int i, j, zPoly[numVisible];
-  // average Z of the polygon
-  for(i = 0; i < numVisible; ++i)
+  sortPolys(v, 3);
+}
+
+// per frame polygon setup: edge x steps, Y extent and color of the visible polygons (in sorted order),
+// binned by the NLINES high strips the polygon touches (binPolys[binStart[s] .. binStart[s + 1] - 1])
+// the edge endpoints are read from the projected vertices
+#define NSTRIPS ((HT_3D + NLINES - 1) / NLINES)
+int32_t *edgeDxdy;
+int16_t *polyY1, *polyY2;
+uint16_t *polyCol;
+int binStart[NSTRIPS + 1];
+uint16_t *binPolys = 0;  // grown when a frame needs more entries (large polygons span more strips)
+int binSize = 0;
+int polyVerts;
+int16_t *polyProj;  // projected vertices
+
+// linear interpolation planes of the polygon (16.16 fixed point) from its first 3 vertices:
+// value(x, y) = value0 + (x - x of vertex 0) * d/dx + (y - y of vertex 0) * d/dy
+
+// Gouraud intensity plane, 0..255 (16.16 fixed point)
+#define GMAX     (256 * 65536 - 1)
+#define GGRADMAX (8 << 16)
+int32_t *polyG = 0, *polyDgdx, *polyDgdy;
+int16_t *vertG;
+uint16_t shadeCol[256];
+
+#if ZBUFFER == 1
+// depth plane, the Z-buffer holds (z + ZOFS) in 12.4 fixed point, 0xffff = empty
+#define ZOFS     1024
+#define ZGRADMAX (64 << 16)
+// allocated in the D2 ram (the DTCM is full with frBuf, the D1 ram with the framebuffer)
+int32_t *polyZ = 0, *polyDzdx, *polyDzdy;
+uint16_t *zBuf = 0;
+#endif
+
+// plane gradient n / d in 16.16 fixed point, limited to +-max (nearly edge-on polygons)
+int32_t planeGrad(int64_t n, int64_t d, int32_t max)
+{
+  if(d == 0)
+    return 0;
+  n = n * 65536 / d;
+  return n > max ? max : n < -max ? -max : n;
+}
+
+// unit vertex normals (* 127) of the model for the Gouraud shading: the sum of the (area weighted) normals
+// of the polygons around the vertex, calculated once when the model changes (n: numVerts * 3 work array)
+int8_t *vertN;
+
+void normalVerts(int nv, int32_t *n)
+{
+  int i, j, k, ax, ay, az, bx, by, bz;
+  int64_t l2, l, m;
+  memset(n, 0, numVerts * 3 * sizeof(int32_t));
+  for(i = 0; i < numPolys; i++)
+  {
+    // same vertex order as the backface culling (cullQuads, cullTris)
+    ax = verts[3 * polys[nv * i + 0] + 0] - verts[3 * polys[nv * i + 1] + 0];
+    ay = verts[3 * polys[nv * i + 0] + 1] - verts[3 * polys[nv * i + 1] + 1];
+    az = verts[3 * polys[nv * i + 0] + 2] - verts[3 * polys[nv * i + 1] + 2];
+    bx = verts[3 * polys[nv * i + 2] + 0] - verts[3 * polys[nv * i + 1] + 0];
+    by = verts[3 * polys[nv * i + 2] + 1] - verts[3 * polys[nv * i + 1] + 1];
+    bz = verts[3 * polys[nv * i + 2] + 2] - verts[3 * polys[nv * i + 1] + 2];
+    for(j = 0; j < nv; j++)
+    {
+      k = polys[nv * i + j];
+      n[3 * k + 0] += ay * bz - az * by;
+      n[3 * k + 1] += az * bx - ax * bz;
+      n[3 * k + 2] += ax * by - ay * bx;
+    }
+  }
+  for(k = 0; k < numVerts; k++)
+  {
+    l2 = (int64_t)n[3 * k + 0] * n[3 * k + 0] + (int64_t)n[3 * k + 1] * n[3 * k + 1] + (int64_t)n[3 * k + 2] * n[3 * k + 2];
+    // integer square root
+    for(l = 0, m = (int64_t)1 << 62; m; m >>= 2)
+    {
+      if(l2 >= l + m)
+      {
+        l2 -= l + m;
+        l = (l >> 1) + m;
+      }
+      else
+        l >>= 1;
+    }
+    for(j = 0; j < 3; j++)
+      vertN[3 * k + j] = l ? n[3 * k + j] * 127 / l : 0;
+  }
+}
+
+// per vertex intensity for the Gouraud shading (light from the viewer: the Z of the rotated vertex normal, rotM row 2)
+void shadeVerts(void)
+{
+  int i, k, x0, y0, z0, c;
+  if(!shadeCol[255])
+    for(i = 0; i < 256; i++)
+      shadeCol[i] = LCD_COLOR(i, i, i/2);
+  for(k = 0; k < numVerts; k++)
+  {
+    x0 = vertN[3 * k + 0];
+    y0 = vertN[3 * k + 1];
+    z0 = vertN[3 * k + 2];
+    c = (rotM[6] * x0 + rotM[7] * y0 + rotM[8] * z0) >> 15;
+    c = (orient ? c : -c) * 255 / 127;
+    vertG[k] = c < 0 ? 0 : c > 255 ? 255 : c;
+  }
+}
+
+// Gouraud shaded span (no division, one add per pixel)
+void gSpan(uint16_t *p, int32_t g, int32_t dgdx, int n)
+{
+  while(n--)
   {
-    zPoly[i] = 0.0;
-    for(j = 0; j < 3; ++j) zPoly[i] += v[3 * polys[3 * sortedPolys[i] + j] + 2];
+    *p++ = shadeCol[g >> 16];
+    g += dgdx;
   }
+}
 
-  // sort by Z
-  for(i = 0; i < numVisible - 1; ++i)
+#if ZBUFFER == 1
+// depth tested span (no division, one add per pixel)
+void zSpan(uint16_t *p, uint16_t *zp, int32_t z, int32_t dzdx, int n, uint16_t c)
+{
+  uint16_t zk;
+  while(n--)
   {
-    for(j = i; j < numVisible; ++j)
+    zk = z >> 12;
+    if(zk < *zp)
     {
-      if(zPoly[i] < zPoly[j])
+      *zp = zk;
+      *p = c;
+    }
+    p++;
+    zp++;
+    z += dzdx;
+  }
+}
+
+// depth tested Gouraud shaded span
+void zgSpan(uint16_t *p, uint16_t *zp, int32_t z, int32_t dzdx, int32_t g, int32_t dgdx, int n)
+{
+  uint16_t zk;
+  while(n--)
+  {
+    zk = z >> 12;
+    if(zk < *zp)
+    {
+      *zp = zk;
+      *p = shadeCol[g >> 16];
+    }
+    p++;
+    zp++;
+    z += dzdx;
+    g += dgdx;
+  }
+}
+#endif
+
+// texture mapping: u / w, v / w and 1 / w are linear in the screen space, planes in TEXQBITS fixed point
+// the span is drawn affine between the perspective correct points (every TEXSUB pixels, one division)
+#define TEXBITS   5                     // 32x32 texture
+#define TEXSIZE   (1 << TEXBITS)
+#define TEXMASK   (TEXSIZE - 1)         // wrap (power of two)
+#define TEXSUBBITS 4
+#define TEXSUB    (1 << TEXSUBBITS)     // perspective correction every 16 pixels
+#define TEXQBITS  28
+typedef struct
+{
+  int32_t q, dqdx, dqdy;                // 1 / w
+  int32_t u, dudx, dudy;                // u / w
+  int32_t v, dvdx, dvdy;                // v / w
+}TexPlane;
+TexPlane *texPlanes = 0;
+const uint16_t *texels;
+#if TEXCACHE == 1
+uint16_t texCache[TEXSIZE * TEXSIZE];   // in the DTCM ram (.bss)
+const uint16_t *texCached = 0;
+#endif
+// texture coordinates of the first 3 vertices (quads: full texture, tris: half texture)
+const uint8_t texU[2][3] = {{0, TEXSIZE, 0}, {0, TEXSIZE, TEXSIZE}};
+const uint8_t texV[2][3] = {{0, 0, TEXSIZE}, {0, 0, TEXSIZE}};
+
+// plane gradient n / d, limited (nearly edge-on polygons)
+int32_t texGrad(int64_t n, int64_t d)
+{
+  if(d == 0)
+    return 0;
+  n = n / d;
+  return n > 0x3fffffff ? 0x3fffffff : n < -0x3fffffff ? -0x3fffffff : n;
+}
+
+// u, v (16.16 fixed point) from the planes (the only division of the texture mapping)
+// r <= 2^31, u / w and v / w are limited to +-2^31 (extrapolated past the polygon edge): the products fit in 64 bits
+#define TEXUQMAX  ((int64_t)1 << 31)
+void texUV(int64_t q, int64_t uq, int64_t vq, int32_t *u, int32_t *v)
+{
+  int64_t r;
+  if(q < (1 << 15))
+    q = 1 << 15;
+  r = ((int64_t)1 << 46) / q;
+  uq = uq > TEXUQMAX ? TEXUQMAX : uq < -TEXUQMAX ? -TEXUQMAX : uq;
+  vq = vq > TEXUQMAX ? TEXUQMAX : vq < -TEXUQMAX ? -TEXUQMAX : vq;
+  *u = (uq * r) >> 30;
+  *v = (vq * r) >> 30;
+}
+
+// texture mapped span, x and y relative to vertex 0 of the polygon
+// with Z-buffer: depth tested (zp, z, dzdx like zSpan)
+void tSpan(uint16_t *p, uint16_t *zp, int32_t z, int32_t dzdx, TexPlane *t, int x, int y, int n)
+{
+  int64_t q = t->q + (int64_t)x * t->dqdx + (int64_t)y * t->dqdy;
+  int64_t uq = t->u + (int64_t)x * t->dudx + (int64_t)y * t->dudy;
+  int64_t vq = t->v + (int64_t)x * t->dvdx + (int64_t)y * t->dvdy;
+  int32_t u, v, u1, v1, du, dv;
+  int m;
+  #if ZBUFFER == 1
+  uint16_t zk;
+  #endif
+  texUV(q, uq, vq, &u, &v);
+  while(n > 0)
+  {
+    q += (int64_t)t->dqdx * TEXSUB;
+    uq += (int64_t)t->dudx * TEXSUB;
+    vq += (int64_t)t->dvdx * TEXSUB;
+    texUV(q, uq, vq, &u1, &v1);
+    // the texture wraps, u and v can be far apart on nearly edge-on polygons (64 bit difference)
+    du = ((int64_t)u1 - u) >> TEXSUBBITS;
+    dv = ((int64_t)v1 - v) >> TEXSUBBITS;
+    m = n < TEXSUB ? n : TEXSUB;
+    n -= m;
+    while(m--)
+    {
+      #if ZBUFFER == 1
+      zk = z >> 12;
+      if(zk < *zp)
       {
-        swap(zPoly[j], zPoly[i]);
-        swap(sortedPolys[j], sortedPolys[i]);
+        *zp = zk;
+        *p = texels[(((v >> 16) & TEXMASK) << TEXBITS) + ((u >> 16) & TEXMASK)];
       }
+      zp++;
+      z += dzdx;
+      #else
+      *p = texels[(((v >> 16) & TEXMASK) << TEXBITS) + ((u >> 16) & TEXMASK)];
+      #endif
+      p++;
+      u += du;
+      v += dv;
     }
+    u = u1;
+    v = v1;
   }
 }
 
-void drawQuads(int16_t *v2d)
+// work arrays of the model: one block from the D2 ram heap (the DTCM is full with frBuf, the D1 ram with the framebuffer),
+// reallocated when the model, its vertices per polygon (nv) or its texture / Gouraud mode changes
+void *meshWork = 0;
+int16_t *meshVerts;
+uint16_t *meshPolys;
+uint32_t meshKey;
+
+void meshWorkFree(void)
 {
-  int q, v0, v1, v2, v3, c, i;
-  for(i = 0; i < numVisible; i++)
+  if(meshWork)
+    d2Free(meshWork);
+  meshWork = 0;
+}
+
+#define MESHARRAY(p, n)  {p = (void *)(base + size); size += ((n) * sizeof(*p) + 3) & ~3;}
+
+int meshAlloc(int nv)
+{
+  uintptr_t base;
+  uint32_t size, key;
+  int pass, g = gouraud && lightShade > 0;
+  int32_t *n;
+  key = meshSerial << 8 | nv << 2 | g << 1 | (texture != 0);
+  if(meshWork && verts == meshVerts && polys == meshPolys && key == meshKey)
+    return 1;
+  meshWorkFree();
+  polyG = 0;
+  texPlanes = 0;
+  #if ZBUFFER == 1
+  polyZ = 0;
+  if(!zBuf)
+    zBuf = d2Malloc(WD_3D * NLINES * sizeof(uint16_t));
+  if(!zBuf)
+    return 0;
+  #endif
+  // pass 0: size of the block, pass 1: addresses of the arrays
+  for(pass = 0, base = 0; pass < 2; pass++)
   {
-    q = sortedPolys[i];
-    v0 = polys[4 * q + 0];
-    v1 = polys[4 * q + 1];
-    v2 = polys[4 * q + 2];
-    v3 = polys[4 * q + 3];
-    if(lightShade > 0)
+    size = 0;
+    MESHARRAY(transVerts, numVerts * 3);
+    MESHARRAY(projVerts, numVerts * 2);
+    MESHARRAY(projW, numVerts);
+    MESHARRAY(sortedPolys, numPolys);
+    MESHARRAY(normZ, numPolys);
+    MESHARRAY(zPoly, numPolys);
+    MESHARRAY(tmpPolys, numPolys);
+    MESHARRAY(edgeDxdy, numPolys * nv);
+    MESHARRAY(polyY1, numPolys);
+    MESHARRAY(polyY2, numPolys);
+    MESHARRAY(polyCol, numPolys);
+    if(g)
     {
-      c = normZ[q] * 255 / lightShade;
-      if(c > 255)
-        c=255;
-      drawQuad(v2d[2 * v0 + 0], v2d[2 * v0 + 1], v2d[2 * v1 + 0], v2d[2 * v1 + 1], v2d[2 * v2 + 0], v2d[2 * v2 + 1], v2d[2 * v3 + 0], v2d[2 * v3 + 1], LCD_COLOR(c, c, c/2));
+      MESHARRAY(vertG, numVerts);
+      MESHARRAY(vertN, numVerts * 3);
+      MESHARRAY(polyG, numPolys);
+      MESHARRAY(polyDgdx, numPolys);
+      MESHARRAY(polyDgdy, numPolys);
+    }
+    #if ZBUFFER == 1
+    MESHARRAY(polyZ, numPolys);
+    MESHARRAY(polyDzdx, numPolys);
+    MESHARRAY(polyDzdy, numPolys);
+    #endif
+    if(texture)
+      MESHARRAY(texPlanes, numPolys);
+    if(!pass)
+    {
+      meshWork = d2Malloc(size);
+      if(!meshWork)
+      {
+        polyG = 0;
+        texPlanes = 0;
+        #if ZBUFFER == 1
+        polyZ = 0;
+        #endif
+        return 0;
+      }
+      base = (uintptr_t)meshWork;
+    }
+  }
+  meshVerts = verts;
+  meshPolys = polys;
+  meshKey = key;
+
+  if(g)
+  {
+    if(meshNormals)
+      memcpy(vertN, meshNormals, numVerts * 3);
+    else if((n = d2Malloc(numVerts * 3 * sizeof(int32_t))) != 0)
+    {
+      normalVerts(nv, n);
+      d2Free(n);
     }
     else
-      drawQuad(v2d[2 * v0 + 0], v2d[2 * v0 + 1], v2d[2 * v1 + 0], v2d[2 * v1 + 1], v2d[2 * v2 + 0], v2d[2 * v2 + 1], v2d[2 * v3 + 0], v2d[2 * v3 + 1], polyColors[q]);
+      memset(vertN, 0, numVerts * 3);
   }
+  return 1;
 }
 
-void drawTris(int16_t *v2d)
+// nv = vertices per polygon
+void setupPolys(int16_t *v3d, int16_t *v2d, int nv)
 {
-  int q, v0, v1, v2, c, i;
+  int i, j, q, k, c, s, yMin, yMax;
+  int k0, k1, k2, ax, ay, bx, by, d, x0, y0, x1, y1;
+  polyVerts = nv;
+  polyProj = v2d;
+  if(texture)
+  {
+    #if TEXCACHE == 1
+    if(texCached != texture)
+    {
+      memcpy(texCache, texture, sizeof(texCache));
+      texCached = texture;
+    }
+    texels = texCache;
+    #else
+    texels = texture;
+    #endif
+  }
+  memset(binStart, 0, sizeof(binStart));
   for(i = 0; i < numVisible; i++)
   {
     q = sortedPolys[i];
-    v0 = polys[3 * q + 0];
-    v1 = polys[3 * q + 1];
-    v2 = polys[3 * q + 2];
     if(lightShade > 0)
     {
-      c = normZ[q] * 255 / 18000;
+      c = normZ[q] * 255 / (nv == 4 ? lightShade : triShade);
       if(c > 255)
         c = 255;
-      drawTri(v2d[2 * v0 + 0], v2d[2 * v0 + 1], v2d[2 * v1 + 0], v2d[2 * v1 + 1], v2d[2 * v2 + 0], v2d[2 * v2 + 1], LCD_COLOR(c, c, c/2));
+      polyCol[i] = LCD_COLOR(c, c, c/2);
     }
     else
-      drawTri(v2d[2 * v0 + 0], v2d[2 * v0 + 1], v2d[2 * v1 + 0], v2d[2 * v1 + 1], v2d[2 * v2 + 0], v2d[2 * v2 + 1], polyColors[q]);
+      polyCol[i] = polyColors[q];
+
+    yMin = 0x7fff;
+    yMax = -0x7fff;
+    for(j = 0; j < nv; j++)
+    {
+      k = polys[nv * q + j];
+      x0 = v2d[2 * k + 0];
+      y0 = v2d[2 * k + 1];
+      k = polys[nv * q + (j + 1 < nv ? j + 1 : 0)];
+      x1 = v2d[2 * k + 0];
+      y1 = v2d[2 * k + 1];
+      if(y0 > y1)
+      {
+        swap(x0, x1);
+        swap(y0, y1);
+      }
+      edgeDxdy[nv * i + j] = y1 > y0 ? (x1 - x0) * 65536 / (y1 - y0) : 0;
+      if(y0 < yMin)
+        yMin = y0;
+      if(y1 > yMax)
+        yMax = y1;
+    }
+
+    // interpolation planes from the first 3 vertices
+    k0 = polys[nv * q + 0];
+    k1 = polys[nv * q + 1];
+    k2 = polys[nv * q + 2];
+    ax = v2d[2 * k1 + 0] - v2d[2 * k0 + 0];
+    ay = v2d[2 * k1 + 1] - v2d[2 * k0 + 1];
+    bx = v2d[2 * k2 + 0] - v2d[2 * k0 + 0];
+    by = v2d[2 * k2 + 1] - v2d[2 * k0 + 1];
+    d = ax * by - bx * ay;
+    if(gouraud && lightShade > 0)
+    {
+      int az = vertG[k1] - vertG[k0], bz = vertG[k2] - vertG[k0];
+      polyG[i] = vertG[k0] * 65536 + 0x8000;
+      polyDgdx[i] = planeGrad(az * by - bz * ay, d, GGRADMAX);
+      polyDgdy[i] = planeGrad(bz * ax - az * bx, d, GGRADMAX);
+    }
+    if(texture)
+    {
+      // q = 1 / w, u / w, v / w of the first 3 vertices
+      int64_t q0 = ((int32_t)1 << TEXQBITS) / (projW[k0] > 8 ? projW[k0] : 8);
+      int64_t q1 = ((int32_t)1 << TEXQBITS) / (projW[k1] > 8 ? projW[k1] : 8);
+      int64_t q2 = ((int32_t)1 << TEXQBITS) / (projW[k2] > 8 ? projW[k2] : 8);
+      const uint8_t *tu = texU[nv - 3], *tv = texV[nv - 3];
+      TexPlane *t = &texPlanes[i];
+      int64_t az, bz;
+      t->q = q0;
+      az = q1 - q0;
+      bz = q2 - q0;
+      t->dqdx = texGrad(az * by - bz * ay, d);
+      t->dqdy = texGrad(bz * ax - az * bx, d);
+      t->u = tu[0] * q0;
+      az = tu[1] * q1 - tu[0] * q0;
+      bz = tu[2] * q2 - tu[0] * q0;
+      t->dudx = texGrad(az * by - bz * ay, d);
+      t->dudy = texGrad(bz * ax - az * bx, d);
+      t->v = tv[0] * q0;
+      az = tv[1] * q1 - tv[0] * q0;
+      bz = tv[2] * q2 - tv[0] * q0;
+      t->dvdx = texGrad(az * by - bz * ay, d);
+      t->dvdy = texGrad(bz * ax - az * bx, d);
+    }
+    #if ZBUFFER == 1
+    {
+      int az = v3d[3 * k1 + 2] - v3d[3 * k0 + 2], bz = v3d[3 * k2 + 2] - v3d[3 * k0 + 2];
+      polyZ[i] = (v3d[3 * k0 + 2] + ZOFS) * 65536;
+      polyDzdx[i] = planeGrad(az * by - bz * ay, d, ZGRADMAX);
+      polyDzdy[i] = planeGrad(bz * ax - az * bx, d, ZGRADMAX);
+    }
+    #endif
+
+    if(yMin < 0)
+      yMin = 0;
+    if(yMax >= HT_3D)
+      yMax = HT_3D - 1;
+    polyY1[i] = yMin;
+    polyY2[i] = yMax;
+    if(yMin <= yMax)
+      for(s = yMin / NLINES; s <= yMax / NLINES; s++)
+        binStart[s + 1]++;
+  }
+
+  for(s = 0; s < NSTRIPS; s++)
+    binStart[s + 1] += binStart[s];
+  if(binStart[NSTRIPS] > binSize)
+  {
+    if(binPolys)
+      d2Free(binPolys);
+    binSize = binStart[NSTRIPS] + binStart[NSTRIPS] / 4;
+    binPolys = d2Malloc(binSize * sizeof(uint16_t));
+    if(!binPolys)
+    {
+      binSize = 0;
+      memset(binStart, 0, sizeof(binStart));
+      return;
+    }
+  }
+  for(i = 0; i < numVisible; i++)
+    if(polyY1[i] <= polyY2[i])
+      for(s = polyY1[i] / NLINES; s <= polyY2[i] / NLINES; s++)
+        binPolys[binStart[s]++] = i;
+  for(s = NSTRIPS; s > 0; s--)
+    binStart[s] = binStart[s - 1];
+  binStart[0] = 0;
+}
+
+// draw the polygons binned to the strip at yFr, only the rows they cover
+// with Z-buffer front to back (the nearest pixels are written first, the hidden ones are rejected by the depth test)
+void drawPolys(void)
+{
+  int b, i, j, q, k, x, y, y1, y2, n, s = yFr / NLINES;
+  int x0, y0, xe, ye, px, py;
+  int32_t g = 0, g1, dg = 0;
+  uint16_t *p;
+  int16_t line[NLINES * 2];
+  #if ZBUFFER == 1
+  memset(zBuf, 0xff, WD_3D * NLINES * sizeof(uint16_t));
+  for(b = binStart[s + 1] - 1; b >= binStart[s]; b--)
+  #else
+  for(b = binStart[s]; b < binStart[s + 1]; b++)
+  #endif
+  {
+    i = binPolys[b];
+    y1 = (polyY1[i] > yFr ? polyY1[i] : yFr) - yFr;
+    y2 = (polyY2[i] < yFr + NLINES - 1 ? polyY2[i] : yFr + NLINES - 1) - yFr;
+    for(y = y1; y <= y2; y++)
+    {
+      line[2 * y + 0] = WD_3D + 1;
+      line[2 * y + 1] = -1;
+    }
+
+    q = sortedPolys[i];
+    for(j = 0; j < polyVerts; j++)
+    {
+      k = polys[polyVerts * q + j];
+      x0 = polyProj[2 * k + 0];
+      y0 = polyProj[2 * k + 1];
+      k = polys[polyVerts * q + (j + 1 < polyVerts ? j + 1 : 0)];
+      xe = polyProj[2 * k + 0];
+      ye = polyProj[2 * k + 1];
+      if(y0 > ye)
+        rasterize(xe, ye, x0, y0, edgeDxdy[polyVerts * i + j], line);
+      else
+        rasterize(x0, y0, xe, ye, edgeDxdy[polyVerts * i + j], line);
+    }
+    // vertex 0 (origin of the interpolation planes)
+    px = polyProj[2 * polys[polyVerts * q] + 0];
+    py = polyProj[2 * polys[polyVerts * q] + 1] - yFr;
+
+    for(y = y1; y <= y2; y++)
+      if(line[2 * y + 1] > line[2 * y + 0])
+      {
+        x = line[2 * y + 0];
+        p = &frBuf[SCR_WD * y + x];
+        #if ZBUFFER == 1
+        // half open span: the right edge pixel belongs to the neighbour polygon (no depth fight on the shared edges)
+        n = line[2 * y + 1] - x + (line[2 * y + 1] == WD_3D - 1);
+        #else
+        n = line[2 * y + 1] - x + 1;
+        #endif
+        if(gouraud && lightShade > 0)
+        {
+          g = polyG[i] + (x - px) * polyDgdx[i] + (y - py) * polyDgdy[i];
+          dg = polyDgdx[i];
+          g1 = g + dg * (n - 1);
+          if(g < 0 || g > GMAX || g1 < 0 || g1 > GMAX)
+          {
+            // out of range at the span ends (thin polygon edge pixels): flat span
+            g = g / 2 + g1 / 2;
+            g = g < 0 ? 0 : g > GMAX ? GMAX : g;
+            dg = 0;
+          }
+        }
+        #if ZBUFFER == 1
+        if(texture)
+          tSpan(p, &zBuf[WD_3D * y + x], polyZ[i] + (x - px) * polyDzdx[i] + (y - py) * polyDzdy[i],
+                polyDzdx[i], &texPlanes[i], x - px, y - py, n);
+        else if(gouraud && lightShade > 0)
+          zgSpan(p, &zBuf[WD_3D * y + x], polyZ[i] + (x - px) * polyDzdx[i] + (y - py) * polyDzdy[i],
+                 polyDzdx[i], g, dg, n);
+        else
+          zSpan(p, &zBuf[WD_3D * y + x], polyZ[i] + (x - px) * polyDzdx[i] + (y - py) * polyDzdy[i],
+                polyDzdx[i], n, polyCol[i]);
+        #else
+        if(texture)
+          tSpan(p, 0, 0, 0, &texPlanes[i], x - px, y - py, n);
+        else if(gouraud && lightShade > 0)
+          gSpan(p, g, dg, n);
+        else
+          LCD_FillSpan16(p, polyCol[i], n);
+        #endif
+      }
   }
 }
 
@@ -429,8 +994,7 @@ void initStars()
 void backgroundStars(int f)
 {
   int i;
-  for(i = 0; i < NLINES * WD_3D; i++)
-    frBuf[i] = LCD_COLOR_BLACK;
+  LCD_FillSpan16(frBuf, LCD_COLOR_BLACK, NLINES * WD_3D);
   for(i = 0; i < NUM_STARS; i++)
   {
     int r = 255 - stars[i].z / 5;
@@ -449,47 +1013,155 @@ void backgroundStars(int f)
 
 // ------------------------------------------------
 
+// ------------------------------------------------
+
+void matIdentity(int16_t *m)
+{
+  memset(m, 0, 9 * sizeof(int16_t));
+  m[0] = m[4] = m[8] = Q15ONE;
+}
+
+// m = rotation around the axis (0 = X, 1 = Y, 2 = Z) * m, the order of the calls is the order of the rotations
+// (Y: x' = x * cos + z * sin, X: y' = y * cos + z * sin, Z: x' = x * cos + y * sin)
+void matRotate(int16_t *m, int axis, int a)
+{
+  int c = fastCos15(a), s = fastSin15(a), i, j, k, m0, m1;
+  i = axis == 0 ? 1 : 0;  // the two rotated rows
+  j = axis == 2 ? 1 : 2;
+  for(k = 0; k < 3; k++)
+  {
+    m0 = m[3 * i + k];
+    m1 = m[3 * j + k];
+    m[3 * i + k] = (c * m0 + s * m1 + 0x4000) >> 15;
+    m[3 * j + k] = (c * m1 - s * m0 + 0x4000) >> 15;
+  }
+}
+
+// t = m * v for n vertices (Q15 matrix, the coordinates must be within -16384..16383)
+// Cortex-M4/M7: one SMLAD for x and y (the vertex is loaded as a packed pair), one multiply for z
+void transformVerts(const int16_t *v, int16_t *t, int n, const int16_t *m)
+{
+  #if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP == 1
+  uint32_t m01 = (uint16_t)m[0] | (uint32_t)m[1] << 16;
+  uint32_t m34 = (uint16_t)m[3] | (uint32_t)m[4] << 16;
+  uint32_t m67 = (uint16_t)m[6] | (uint32_t)m[7] << 16;
+  int32_t m2 = m[2], m5 = m[5], m8 = m[8], z;
+  uint32_t xy;
+  while(n--)
+  {
+    xy = __UNALIGNED_UINT32(v);
+    z = v[2];
+    t[0] = (int32_t)__SMLAD(xy, m01, m2 * z + 0x4000) >> 15;
+    t[1] = (int32_t)__SMLAD(xy, m34, m5 * z + 0x4000) >> 15;
+    t[2] = (int32_t)__SMLAD(xy, m67, m8 * z + 0x4000) >> 15;
+    v += 3;
+    t += 3;
+  }
+  #else
+  int32_t x, y, z;
+  while(n--)
+  {
+    x = v[0];
+    y = v[1];
+    z = v[2];
+    t[0] = (m[0] * x + m[1] * y + m[2] * z + 0x4000) >> 15;
+    t[1] = (m[3] * x + m[4] * y + m[5] * z + 0x4000) >> 15;
+    t[2] = (m[6] * x + m[7] * y + m[8] * z + 0x4000) >> 15;
+    v += 3;
+    t += 3;
+  }
+  #endif
+}
+
+// projection scale of a vertex: (k << PROJBITS) / w (k = scale with 8 bit fraction, max. 262143: HT_3D < 1024)
+#define PROJBITS  14
+#define RECIPSIZE 2048
+#if RECIPTAB == 1
+uint32_t *recipTab = 0;  // scale of w = 1..RECIPSIZE - 1 (D2 ram heap, 8 kbytes)
+#endif
+
+int32_t projScale(int w, uint32_t k)
+{
+  if(w < 1)
+    w = 1;
+  #if RECIPTAB == 1
+  if(w < RECIPSIZE && recipTab)
+    return recipTab[w];
+  #endif
+  return ((k << PROJBITS) + w / 2) / w;
+}
+
+uint32_t transCycles = 0;  // DWT cycles of the transform and projection of the last frame (0: no cycle counter)
+
+// projected coordinate limit (nearly behind the viewer), the 16.16 edge steps (x1 - x0) * 65536 must fit in 32 bits
+#define PROJMAX 16383
+
 int t = 0;
 
 // mode=0 for quads, mode=1 for tris
 void render3D(int mode)
 {
-  int cos0, sin0, cos1, sin1;
-  int i, x0, y0, z0, fac, distToObj;
+  int i, distToObj;
   int camZ = 200;
   int scaleFactor = HT_3D / 3; // HT_3D / 4;
   int near = 300;
+  uint32_t projK = scaleFactor * near * 256 / 100;
+  int32_t s, px, py;
+  #ifdef DWT
+  uint32_t cyc;
+  #endif
 
   if(t++ > 360)
     t -= 360;
   distToObj = 150 + 300 * fastSin(3 * t) / MAXSIN;
-  cos0 = fastCos(rot0);
-  sin0 = fastSin(rot0);
-  cos1 = fastCos(rot1);
-  sin1 = fastSin(rot1);
+  #if RECIPTAB == 1
+  if(!recipTab && (recipTab = d2Malloc(RECIPSIZE * sizeof(uint32_t))) != 0)
+    for(i = 1; i < RECIPSIZE; i++)
+      recipTab[i] = ((projK << PROJBITS) + i / 2) / i;
+  #endif
+  meshFail = !meshAlloc(mode ? 3 : 4);
+  if(meshFail)
+    numVerts = numPolys = 0;  // out of memory: background only (showStats reports it)
+
+  #ifdef DWT
+  cyc = DWT->CYCCNT;
+  #endif
+  // rotation around Y, then X, then Z
+  matIdentity(rotM);
+  matRotate(rotM, 1, swingAngle(rot0));
+  matRotate(rotM, 0, swingAngle(rot1));
+  if(rot2)
+    matRotate(rotM, 2, rot2);
+  transformVerts(verts, transVerts, numVerts, rotM);
 
+  // screen = center + scaleFactor * near / 100 * (x, y) / w (8 bit fraction of the scale)
   for(i = 0; i < numVerts; i++)
   {
-    x0 = verts[3 * i + 0];
-    y0 = verts[3 * i + 1];
-    z0 = verts[3 * i + 2];
-    transVerts[3 * i + 0] = (cos0 * x0 + sin0 * z0) / MAXSIN;
-    transVerts[3 * i + 1] = (cos1 * y0 + (cos0 * sin1 * z0 - sin0 * sin1 * x0) / MAXSIN) / MAXSIN;
-    transVerts[3 * i + 2] = camZ + ((cos0 * cos1 * z0 - sin0 * cos1 * x0) / MAXSIN - sin1 * y0) / MAXSIN;
-
-    fac = scaleFactor * near / (transVerts[3 * i + 2] + near + distToObj);
-
-    projVerts[2 * i + 0] = (100 * WD_3D / 2 + fac * transVerts[3 * i + 0] + 100 / 2) / 100;
-    projVerts[2 * i + 1] = (100 * HT_3D / 2 + fac * transVerts[3 * i + 1] + 100 / 2) / 100;
+    transVerts[3 * i + 2] += camZ;
+    projW[i] = transVerts[3 * i + 2] + near + distToObj;
+    s = projScale(projW[i], projK);
+    px = WD_3D / 2 + (((int64_t)transVerts[3 * i + 0] * s + (1 << (PROJBITS + 7))) >> (PROJBITS + 8));
+    py = HT_3D / 2 + (((int64_t)transVerts[3 * i + 1] * s + (1 << (PROJBITS + 7))) >> (PROJBITS + 8));
+    projVerts[2 * i + 0] = px < -PROJMAX ? -PROJMAX : px > PROJMAX ? PROJMAX : px;
+    projVerts[2 * i + 1] = py < -PROJMAX ? -PROJMAX : py > PROJMAX ? PROJMAX : py;
   }
+  #ifdef DWT
+  transCycles = DWT->CYCCNT - cyc;
+  #endif
 
   if(bgMode==3)
     updateStars();
   mode ? cullTris(transVerts) : cullQuads(transVerts);
+  if(gouraud && lightShade > 0)
+    shadeVerts();
+  setupPolys(transVerts, projVerts, mode ? 3 : 4);
 
   for(i = 0; i < HT_3D; i += NLINES)
   {
     yFr = i;
+    #if DOUBLEBUF == 0
+    BSP_LCD_Sync(); /* frBuf may be the source of the previous image copy (DMA2D) */
+    #endif
     if(bgMode == 0)
       backgroundPattern(t, pat2);
     else if(bgMode == 1)
@@ -500,7 +1172,7 @@ void render3D(int mode)
       backgroundStars(t);
     else if(bgMode == 4)
       backgroundChecker(t);
-    mode ? drawTris(projVerts) : drawQuads(projVerts);
+    drawPolys();
     BSP_LCD_DrawRGB16Image(0, yFr, SCR_WD, NLINES, frBuf);
     #if DOUBLEBUF == 1
     if(frBuf == frBuf1)
@@ -0,0 +1,215 @@
+// 3D Filled Vector Graphics
+// mesh files (*.m3d) from the SD card
+
+/*
+ Mesh file format (little endian, the arrays follow the header without padding):
+ - header (M3dHeader, 16 bytes)
+ - int16_t  verts[numVerts * 3]            x, y, z (the built-in models are about -100..100, Y up),
+                                           max. M3D_RADIUS from the origin (else the file is rejected)
+ - uint16_t polys[numPolys * polyVerts]    vertex indices, same vertex order as the built-in models
+ - uint16_t colors[numPolys]               RGB565 polygon colors (if M3D_COLORS)
+ - int8_t   normals[numVerts * 3]          unit vertex normals * 127 for the Gouraud shading (if M3D_NORMALS)
+ The file is read in MESHCHUNK byte pieces straight into one block of the D2 ram heap,
+ the work arrays of the renderer are allocated from the same heap by meshAlloc (gfx3d.h)
+ lightShade is the |normal| of the biggest polygon (obj2m3d.py), the flat shaded triangles of a fine mesh
+ would be almost black with the divisor of the built-in models (M3D1 files had a 16 bit quad only divisor)
+ Quads with vertex normals are split into triangles at loading (the Gouraud plane of a polygon
+ is set from its first 3 vertices, the 4th vertex of a quad would be ignored)
+ (obj2m3d.py converts Wavefront .obj files)
+*/
+
+#define M3D_MAGIC    "M3D2"
+#define M3D_COLORS   0x01    // polygon colors (else light shaded)
+#define M3D_NORMALS  0x02    // vertex normals (Gouraud shading)
+#define M3D_ORIENT   0x04    // front faces are clockwise (orient = 1)
+#define M3D_NOCULL   0x08    // no backface culling (open models)
+
+// max. vertex distance from the origin: the rotated vertex stays in front of the viewer
+// (render3D: w >= z + 650) and its projection within the int16 screen coordinates
+#define M3D_RADIUS   400
+
+typedef struct
+{
+  char     magic[4];         // M3D_MAGIC
+  uint16_t numVerts;         // 1..32767
+  uint16_t numPolys;         // 1..32767 (quads with normals: 1..16383)
+  uint8_t  polyVerts;        // 3 = triangles, 4 = quads
+  uint8_t  flags;            // M3D_...
+  uint16_t reserved;
+  uint32_t lightShade;       // flat shading divisor (0 = default)
+}M3dHeader;
+
+typedef struct
+{
+  M3dHeader h;
+  void     *data;            // one heap block for the arrays below
+  int16_t  *verts;
+  uint16_t *polys;
+  uint16_t *colors;          // 0 = no polygon colors
+  int8_t   *normals;         // 0 = no vertex normals
+}Mesh;
+
+#define MESHNAME 64          // max. path length of the mesh files (longer names are skipped)
+
+Mesh mesh = {0};
+char meshNames[MESHMAX][MESHNAME];
+int numMeshFiles = 0;
+int meshFile = -1;           // index of the loaded file (meshNames)
+
+// read size bytes in MESHCHUNK pieces
+int meshRead(FIL *f, void *dst, uint32_t size)
+{
+  UINT n, br;
+  uint8_t *p = dst;
+  while(size)
+  {
+    n = size < MESHCHUNK ? size : MESHCHUNK;
+    if(f_read(f, p, n, &br) != FR_OK || br != n)
+      return 0;
+    p += n;
+    size -= n;
+  }
+  return 1;
+}
+
+void meshFree(Mesh *m)
+{
+  if(m->data)
+    d2Free(m->data);
+  memset(m, 0, sizeof(Mesh));
+}
+
+// load a mesh file, 1 = ok, 0 = error (the mesh is empty)
+int meshLoad(Mesh *m, const char *fn)
+{
+  FIL f;
+  uint32_t nv, np, pv, sv, sp, sc, sn, i, c;
+  int32_t x, y, z;
+  uint16_t k[4];
+  int ok = 0, split;
+  meshFree(m);
+  meshWorkFree();  // the work arrays of the previous model are reallocated at the next frame
+  if(f_open(&f, fn, FA_READ) != FR_OK)
+    return 0;
+  if(meshRead(&f, &m->h, sizeof(M3dHeader)) && !memcmp(m->h.magic, M3D_MAGIC, 4) &&
+     m->h.numVerts > 0 && m->h.numVerts <= 32767 && m->h.numPolys > 0 && m->h.numPolys <= 32767 &&
+     (m->h.polyVerts == 3 || m->h.polyVerts == 4) &&
+     !(m->h.polyVerts == 4 && (m->h.flags & M3D_NORMALS) && m->h.numPolys > 32767 / 2))
+  {
+    nv = m->h.numVerts;
+    np = m->h.numPolys;
+    pv = m->h.polyVerts;
+    split = pv == 4 && (m->h.flags & M3D_NORMALS);
+    sv = (nv * 3 * sizeof(int16_t) + 3) & ~3;
+    sp = ((split ? np * 6 : np * pv) * sizeof(uint16_t) + 3) & ~3;
+    sc = m->h.flags & M3D_COLORS ? ((split ? np * 2 : np) * sizeof(uint16_t) + 3) & ~3 : 0;
+    sn = m->h.flags & M3D_NORMALS ? nv * 3 : 0;
+    m->data = d2Malloc(sv + sp + sc + sn);
+    if(m->data)
+    {
+      m->verts = m->data;
+      m->polys = (uint16_t *)((uint8_t *)m->data + sv);
+      m->colors = sc ? (uint16_t *)((uint8_t *)m->data + sv + sp) : 0;
+      m->normals = sn ? (int8_t *)m->data + sv + sp + sc : 0;
+      ok = meshRead(&f, m->verts, nv * 3 * sizeof(int16_t)) &&
+           meshRead(&f, m->polys, np * pv * sizeof(uint16_t)) &&
+           (!sc || meshRead(&f, m->colors, np * sizeof(uint16_t))) &&
+           (!sn || meshRead(&f, m->normals, sn));
+      for(i = 0; ok && i < np * pv; i++)
+        if(m->polys[i] >= nv)
+          ok = 0;
+      for(i = 0; ok && i < nv * 3; i += 3)
+      {
+        x = m->verts[i + 0];
+        y = m->verts[i + 1];
+        z = m->verts[i + 2];
+        if(x < -M3D_RADIUS || x > M3D_RADIUS || y < -M3D_RADIUS || y > M3D_RADIUS ||
+           z < -M3D_RADIUS || z > M3D_RADIUS || x * x + y * y + z * z > M3D_RADIUS * M3D_RADIUS)
+          ok = 0;
+      }
+      if(ok && split)
+      {
+        // quad 0123 -> triangles 012 and 023 (same orientation), from the last one (in place)
+        for(i = np; i-- > 0;)
+        {
+          memcpy(k, &m->polys[4 * i], sizeof(k));
+          m->polys[6 * i + 0] = k[0];
+          m->polys[6 * i + 1] = k[1];
+          m->polys[6 * i + 2] = k[2];
+          m->polys[6 * i + 3] = k[0];
+          m->polys[6 * i + 4] = k[2];
+          m->polys[6 * i + 5] = k[3];
+          if(sc)
+          {
+            c = m->colors[i];
+            m->colors[2 * i + 0] = c;
+            m->colors[2 * i + 1] = c;
+          }
+        }
+        m->h.numPolys = np * 2;
+        m->h.polyVerts = 3;
+      }
+    }
+  }
+  f_close(&f);
+  if(!ok)
+    meshFree(m);
+  meshSerial++;
+  return ok;
+}
+
+// collect the names of the mesh files (MESHFOLDER of the SD card)
+void meshScan(void)
+{
+  DIR dir;
+  static FILINFO fno;
+  int l;
+  char path[sizeof(MESHFOLDER) + 4];
+  numMeshFiles = 0;
+  if(f_mount(&SDFatFS, SDPath, 1) != FR_OK)
+    return;
+  strcpy(path, SDPath);
+  strcat(path, MESHFOLDER);
+  l = strlen(path);
+  if(l && path[l - 1] == '/')
+    path[l - 1] = 0;
+  if(f_opendir(&dir, path) != FR_OK)
+    return;
+  while(numMeshFiles < MESHMAX && f_readdir(&dir, &fno) == FR_OK && fno.fname[0])
+  {
+    l = strlen(fno.fname);
+    if(!(fno.fattrib & AM_DIR) && l > 4 && !strcmp(&fno.fname[l - 4], ".m3d") && strlen(path) + l + 2 <= MESHNAME)
+      sprintf(meshNames[numMeshFiles++], "%s/%s", path, fno.fname);
+  }
+  f_closedir(&dir);
+}
+
+// set the model to the mesh file n (loaded when changed)
+void meshSelect(int n)
+{
+  if(n != meshFile)
+  {
+    meshLoad(&mesh, meshNames[n]);
+    meshFile = n;
+  }
+  numVerts   = mesh.h.numVerts;
+  verts      = mesh.verts;
+  numPolys   = mesh.h.numPolys;
+  polys      = mesh.polys;
+  polyColors = mesh.colors;
+  polyMode   = mesh.h.polyVerts == 3;
+  orient     = (mesh.h.flags & M3D_ORIENT) != 0;
+  bfCull     = !(mesh.h.flags & M3D_NOCULL);
+  if(!mesh.colors)
+  {
+    if(polyMode)
+    {
+      lightShade = 20000;
+      triShade   = mesh.h.lightShade ? mesh.h.lightShade : 18000;
+    }
+    else
+      lightShade = mesh.h.lightShade ? mesh.h.lightShade : 20000;
+    gouraud    = mesh.normals != 0;
+    meshNormals = mesh.normals;
+  }
+}
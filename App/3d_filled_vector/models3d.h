@@ -27,7 +27,7 @@ const int16_t vertsCubeQ[] =
 };
 
 const int16_t numQuadsCubeQ = 6;
-const uint8_t quadsCubeQ[] =
+const uint16_t quadsCubeQ[] =
 {
   0, 1, 2, 3,  // front
   7, 6, 5, 4,  // back
@@ -89,7 +89,7 @@ const int16_t vertsCross[] =
 };
 
 const int16_t numQuadsCross = 5+5+3*4;
-const uint8_t quadsCross[] =
+const uint16_t quadsCross[] =
 {
   0, 1, 2, 3,  // front mid
   7, 6, 2, 1,  // front right
@@ -172,7 +172,7 @@ const int16_t verts3[] =
 };
 
 const int16_t numQuads3 = 6*4;
-const uint8_t quads3[] =
+const uint16_t quads3[] =
 {
   0, 1, 2, 3,  // front
   7, 6, 5, 4,  // back
@@ -299,7 +299,7 @@ const int16_t vertsCubes[] =
 };
 
 const int16_t numQuadsCubes = 6*9;
-const uint8_t quadsCubes[] =
+const uint16_t quadsCubes[] =
 {
   0, 1, 2, 3,  // front
   7, 6, 5, 4,  // back
@@ -401,7 +401,7 @@ const int16_t vertsCone[numVertsCone * 3] =
 };
 
 #define numTrisCone 26
-const uint8_t trisCone[numTrisCone * 3] =
+const uint16_t trisCone[numTrisCone * 3] =
 {
   0, 1, 2,
   3, 1, 4,
@@ -454,7 +454,7 @@ const int16_t vertsCube[numVertsCube*3] =
 };
 
 #define numTrisCube  12
-const uint8_t trisCube[numTrisCone*3] =
+const uint16_t trisCube[numTrisCone*3] =
 {
   0, 1, 2,
   2, 3, 0,
@@ -520,7 +520,7 @@ const int16_t vertsTorus[] =
 };
 
 const int16_t numTrisTorus = 72;
-const uint8_t trisTorus[] =
+const uint16_t trisTorus[] =
 {
   0, 1, 2,
   2, 3, 0,
@@ -741,7 +741,7 @@ const int16_t vertsMonkey[] =
 };
 
 const int16_t numTrisMonkey = 223;
-const uint8_t trisMonkey[] =
+const uint16_t trisMonkey[] =
 {
   0, 1, 2,
   2, 3, 0,
@@ -1030,7 +1030,7 @@ const int16_t vertsSphere[] =
 };
 
 const int16_t numTrisSphere = 60;
-const uint8_t trisSphere[] =
+const uint16_t trisSphere[] =
 {
   0, 1, 2,
   2, 3, 0,
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+# 3D Filled Vector Graphics
+# Wavefront .obj to .m3d mesh file converter (file format: mesh3d.h)
+#
+# usage: obj2m3d.py [options] input.obj output.m3d
+#   -s SIZE  model size (the largest coordinate, 1..230, the built-in models are about 100..150)
+#   -f       flat shading (no vertex normals, else Gouraud shading)
+#   -c       polygon colors from the materials (Kd of the .mtl file), no light shading
+#   -q       keep quads (if all faces are quads and no vertex normals: -f or -c), else everything is triangulated
+#   -n       no backface culling (open models)
+# Copy the output files to the MESHFOLDER of the SD card (3d_filled_vector.h).
+
+import argparse
+import math
+import os
+import struct
+
+M3D_COLORS, M3D_NORMALS, M3D_ORIENT, M3D_NOCULL = 0x01, 0x02, 0x04, 0x08
+M3D_RADIUS = 400  # max. vertex distance from the origin (mesh3d.h)
+MAX_SIZE = 230    # MAX_SIZE * sqrt(3) (the corner of the bounding box) + rounding < M3D_RADIUS
+
+
+def rgb565(r, g, b):
+    r, g, b = (max(0, min(255, int(c * 255 + 0.5))) for c in (r, g, b))
+    return (r & 0xF8) << 8 | (g & 0xFC) << 3 | (b & 0xF8) >> 3
+
+
+def read_mtl(path):
+    cols, name = {}, None
+    if not os.path.exists(path):
+        return cols
+    for line in open(path):
+        w = line.split()
+        if not w:
+            continue
+        if w[0] == 'newmtl':
+            name = w[1]
+        elif w[0] == 'Kd' and name:
+            cols[name] = rgb565(*map(float, w[1:4]))
+    return cols
+
+
+def read_obj(path):
+    verts, faces, mtls = [], [], {}
+    col = 0xFFFF
+    for line in open(path):
+        w = line.split()
+        if not w:
+            continue
+        if w[0] == 'v':
+            verts.append(tuple(map(float, w[1:4])))
+        elif w[0] == 'f':
+            idx = [int(x.split('/')[0]) for x in w[1:]]
+            faces.append(([i - 1 if i > 0 else len(verts) + i for i in idx], col))
+        elif w[0] == 'mtllib':
+            mtls.update(read_mtl(os.path.join(os.path.dirname(path), ' '.join(w[1:]))))
+        elif w[0] == 'usemtl':
+            col = mtls.get(w[1], 0xFFFF)
+    return verts, faces
+
+
+def cross(a, b):
+    return (a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0])
+
+
+def sub(a, b):
+    return (a[0] - b[0], a[1] - b[1], a[2] - b[2])
+
+
+def main():
+    ap = argparse.ArgumentParser(description='Wavefront .obj to .m3d mesh file converter')
+    ap.add_argument('input')
+    ap.add_argument('output')
+    ap.add_argument('-s', type=int, default=120, help='model size')
+    ap.add_argument('-f', action='store_true', help='flat shading (no vertex normals)')
+    ap.add_argument('-c', action='store_true', help='polygon colors from the materials')
+    ap.add_argument('-q', action='store_true', help='keep quads')
+    ap.add_argument('-n', action='store_true', help='no backface culling')
+    a = ap.parse_args()
+    if not 1 <= a.s <= MAX_SIZE:
+        raise SystemExit('model size out of range (1..%d)' % MAX_SIZE)
+
+    verts, faces = read_obj(a.input)
+    if not verts or not faces:
+        raise SystemExit('no vertices / faces')
+    # the Gouraud plane of a polygon is set from its first 3 vertices: triangles with vertex normals
+    nv = 4 if a.q and (a.f or a.c) and all(len(f) == 4 for f, c in faces) else 3
+    polys, cols = [], []
+    for f, c in faces:
+        if nv == 4:
+            polys.append(f)
+            cols.append(c)
+        else:
+            for i in range(1, len(f) - 1):  # triangle fan
+                polys.append([f[0], f[i], f[i + 1]])
+                cols.append(c)
+    if len(verts) > 32767 or len(polys) > 32767:
+        raise SystemExit('too many vertices / polygons (max. 32767)')
+
+    # centered and scaled, the screen Y and the view direction (Z) are the opposite of the .obj
+    lo = [min(v[i] for v in verts) for i in range(3)]
+    hi = [max(v[i] for v in verts) for i in range(3)]
+    mid = [(lo[i] + hi[i]) / 2 for i in range(3)]
+    k = a.s / max(max(hi[i] - mid[i] for i in range(3)), 1e-9)
+    qv = [(round((v[0] - mid[0]) * k), round(-(v[1] - mid[1]) * k), round(-(v[2] - mid[2]) * k)) for v in verts]
+
+    # vertex normals like the renderer's normalVerts (gfx3d.h), counterclockwise .obj faces: orient = 1
+    normals = b''
+    if not a.f and not a.c:
+        n = [[0, 0, 0] for v in qv]
+        for p in polys:
+            c = cross(sub(qv[p[0]], qv[p[1]]), sub(qv[p[2]], qv[p[1]]))
+            for i in p:
+                n[i] = [n[i][j] + c[j] for j in range(3)]
+        for v in n:
+            l = math.sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2])
+            normals += struct.pack('<3b', *[int(v[j] * 127 / l) if l else 0 for j in range(3)])
+
+    # flat shading divisor: the |normal| of the largest polygon (it is drawn with the full intensity)
+    shade = max(math.sqrt(sum(c * c for c in cross(sub(qv[p[0]], qv[p[1]]), sub(qv[p[2]], qv[p[1]])))) for p in polys)
+    shade = max(1, int(shade))
+
+    flags = M3D_ORIENT | (M3D_COLORS if a.c else 0) | (M3D_NORMALS if normals else 0) | (M3D_NOCULL if a.n else 0)
+    with open(a.output, 'wb') as o:
+        o.write(struct.pack('<4sHHBBHI', b'M3D2', len(qv), len(polys), nv, flags, 0, shade))
+        for v in qv:
+            o.write(struct.pack('<3h', *v))
+        for p in polys:
+            o.write(struct.pack('<%dH' % nv, *p))
+        if a.c:
+            o.write(struct.pack('<%dH' % len(cols), *cols))
+        o.write(normals)
+    print('%s: %d vertices, %d %s' % (a.output, len(qv), len(polys), 'quads' if nv == 4 else 'triangles'))
+
+
+if __name__ == '__main__':
+    main()
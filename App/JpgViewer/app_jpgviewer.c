@@ -62,6 +62,19 @@ static uint8_t Jpeg_CallbackFunction(uint8_t* Row, uint32_t DataLength)
   uint32_t i = 0;
   RGB_matrix =  (RGB_typedef*)Row;
 
+  /* the previous line may still be copied from RGB16Buffer (DMA2D) */
+  BSP_LCD_Sync();
+  #if LCD_COLORBITDEPTH >= 24
+  /* full color: only the first and the third byte are swapped (B, G, R byte order for the RGB888 image) */
+  for(i = 0; i < cinfo.image_width; i++)
+  {
+    uint8_t t = RGB_matrix[i].B;
+    RGB_matrix[i].B = RGB_matrix[i].R;
+    RGB_matrix[i].R = t;
+  }
+  BSP_LCD_DrawRGB24Image(0, line_counter, cinfo.image_width, 1, Row);
+  BSP_LCD_Sync();                     /* the row buffer is used by the next jpeg_read_scanlines */
+  #else
   for(i = 0; i < cinfo.image_width; i++)
   {
     RGB16Buffer[i] = (uint16_t)
@@ -72,6 +85,7 @@ static uint8_t Jpeg_CallbackFunction(uint8_t* Row, uint32_t DataLength)
     );
   }
   BSP_LCD_DrawRGB16Image(0, line_counter, cinfo.image_width, 1, RGB16Buffer);
+  #endif
   line_counter++;
   return 0;
 }
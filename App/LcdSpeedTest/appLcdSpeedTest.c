@@ -97,6 +97,7 @@ uint32_t ClearTest(void)
 {
   uint32_t ctStartT = GetTime();
   BSP_LCD_Clear(LCD_COLOR_BLACK);
+  BSP_LCD_Sync();
   return(GetTime() - ctStartT);
 }
 
@@ -149,6 +150,7 @@ uint32_t FillRectTest(uint32_t n)
     BSP_LCD_SetTextColor(RD(random() % 0xFFFF));
     BSP_LCD_FillRect(x, y, w, h);
   }
+  BSP_LCD_Sync();
   return(GetTime() - ctStartT);
 }
 
@@ -238,6 +240,27 @@ uint32_t FillCircleTest(uint32_t n)
   return(GetTime() - ctStartT);
 }
 
+//-----------------------------------------------------------------------------
+uint32_t FillTriangleTest(uint32_t n)
+{
+  uint16_t c, x1, y1, x2, y2, x3, y3;
+
+  uint32_t ctStartT = GetTime();
+  for(uint32_t i = 0; i < n; i++)
+  {
+    x1 = random() % BSP_LCD_GetXSize();
+    y1 = random() % BSP_LCD_GetYSize();
+    x2 = random() % BSP_LCD_GetXSize();
+    y2 = random() % BSP_LCD_GetYSize();
+    x3 = random() % BSP_LCD_GetXSize();
+    y3 = random() % BSP_LCD_GetYSize();
+    c = random() % 0xFFFF;
+    BSP_LCD_SetTextColor(RD(c));
+    BSP_LCD_FillTriangle(x1, y1, x2, y2, x3, y3);
+  }
+  return(GetTime() - ctStartT);
+}
+
 //-----------------------------------------------------------------------------
 uint32_t ColorTest(void)
 {
@@ -282,6 +305,7 @@ uint32_t BitmapTest(uint32_t n)
     y = random() % (BSP_LCD_GetYSize() - rombitmap.infoHeader.biHeight);
     BSP_LCD_DrawBitmap(x, y, (uint8_t *)&rombitmap);
   }
+  BSP_LCD_Sync();
   return(GetTime() - ctStartT);
 }
 
@@ -444,6 +468,14 @@ void mainApp(void)
     POWERMETER_PRINT;
     Delay(DELAY_CHAPTER);
 
+    BSP_LCD_Clear(LCD_COLOR_BLACK);
+    POWERMETER_START;
+    t = FillTriangleTest(250);
+    POWERMETER_STOP;
+    printf("Fill Triangle Test: %d ms", (int)t);
+    POWERMETER_PRINT;
+    Delay(DELAY_CHAPTER);
+
     BSP_LCD_Clear(LCD_COLOR_BLACK);
     POWERMETER_START;
     t = CharTest(5000);
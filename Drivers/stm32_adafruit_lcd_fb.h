@@ -7,6 +7,31 @@
  * 2019.05 Add v1.1 extension (#ifdef   LCD_DRVTYPE_V1_1)
  * 2019.11 Add BSP_LCD_FillTriangle
  * 2019.12 Add LCD_DEFAULT_FONT, LCD_DEFAULT_BACKCOLOR, LCD_DEFAULT_TEXTCOLOR, LCD_INIT_CLEAR
+ * 2026.10 Add LCD_FillSpan8/16/24/32 (word wide span fill)
+ * 2026.10 Add LCD_DMA2D, BSP_LCD_Fence, BSP_LCD_FenceDone, BSP_LCD_WaitFence, BSP_LCD_Sync
+ * 2026.10 Add LCD_BUFFERS, LCD_BUFFER_COPY, BSP_LCD_SwapBuffers
+ * 2026.10 Add LCD_DIRTY, BSP_LCD_SetDirty, BSP_LCD_ClearDirty, BSP_LCD_GetDirtyRect, BSP_LCD_GetDirtyRects
+ * 2026.10 Add BSP_LCD_SetClipRect, BSP_LCD_ResetClipRect, BSP_LCD_GetClipRect
+            (every drawing function is clipped, the uint16_t positions are taken as int16_t, they can be negative)
+ * 2026.10 Add BSP_LCD_DrawLineAA, BSP_LCD_DrawCircleAA, BSP_LCD_DrawEllipseAA, BSP_LCD_DrawPolygonAA
+ * 2026.10 Add BSP_LCD_BlendRect, BSP_LCD_DrawARGBImage (LCD_ARGB8888, LCD_ARGB4444, LCD_A8)
+ * 2026.10 Add BSP_LCD_SetTextMode, BSP_LCD_GetTextMode (LCD_TEXT_OPAQUE, LCD_TEXT_TRANSPARENT)
+ * 2026.10 Modify 24 bits/pixel: packed RGB888 framebuffer (PIXELVAL, LCD_PIXEL_WR, LCD_PIXEL_RD)
+ * 2026.10 Modify 32 bits/pixel: ARGB8888 with per pixel alpha (LCD_COLOR_ARGB), the LTDC layer pixel format
+            is set by BSP_LCD_Init
+ * 2026.10 Add BSP_LCD_DrawRGB24Image
+ * 2026.10 Add surfaces: BSP_LCD_InitSurface, BSP_LCD_CreateSurface, BSP_LCD_DeleteSurface, BSP_LCD_SubSurface,
+            BSP_LCD_SelectTarget, BSP_LCD_GetTarget, BSP_LCD_DrawSurface (LCD_FrameBuffer.Stride)
+ * 2026.10 Modify BSP_LCD_FillPolygon: scanline fill (concave and self-intersecting polygons),
+            add BSP_LCD_SetFillRule, BSP_LCD_GetFillRule (LCD_FILL_NONZERO, LCD_FILL_EVENODD), LCD_POLY_EDGES
+ * 2026.10 Modify BSP_LCD_FillTriangle, BSP_LCD_FillCircle, BSP_LCD_FillEllipse: no per line division, no overdraw
+ * 2026.10 Add LCD_OVERLAY, LTDC layer 2 overlay: BSP_LCD_OverlayInit, BSP_LCD_OverlayShow, BSP_LCD_OverlayMove,
+            BSP_LCD_OverlaySetAlpha, BSP_LCD_OverlaySetColorKey, BSP_LCD_OverlayResetColorKey, BSP_LCD_OverlaySetPalette,
+            BSP_LCD_OverlayFillRect, BSP_LCD_OverlayDisplayStringAt
+ * 2026.10 Add BSP_LCD_SetPalette, BSP_LCD_GetPalette, BSP_LCD_CyclePalette, BSP_LCD_FadePalette (8 bits/pixel),
+            BSP_LCD_ColorFromRgb, BSP_LCD_ColorToRgb
+ * 2026.10 Add LCD_LINEDOUBLE (half height framebuffer, every line is displayed twice), BSP_LCD_LineEvent
+ * 2026.10 Add LCD_STRIPS (beam racing strip ring scanout, no full framebuffer), BSP_LCD_StripFrame, BSP_LCD_StripLate
 */
 
 /**
@@ -68,36 +93,196 @@
 #define LCD_INIT_CLEAR           1
 
 /* Bitdepth
-   - 8: 8 bits/pixel
-   - 16: 16 bits/pixel
-   - 24: 24 bits/pixel
-   - 32: 32 bits/pixel */
+   - 8: 8 bits/pixel (palette index, the default palette is RGB332, see BSP_LCD_SetPalette)
+   - 16: 16 bits/pixel (RGB565)
+   - 24: 24 bits/pixel (packed RGB888, 3 bytes/pixel)
+   - 32: 32 bits/pixel (ARGB8888, the alpha is used by the LTDC layer blending)
+   note: COLORVAL is the color value type, PIXELVAL is the framebuffer element type
+         (the pixels are accessed with LCD_PIXEL_WR and LCD_PIXEL_RD) */
 #define LCD_COLORBITDEPTH        16
 
 #if   LCD_COLORBITDEPTH == 8
 #define COLORVAL  uint8_t
+#define PIXELVAL  uint8_t
 #define LCD_BPP   1
 #define LCD_COLOR(r, g, b)       ((r & 0xE0) | (g & 0xE0) >> 3 | (b & 0xC0) >> 6)
 #define LCD_COLOR_FROM_RGB565(c) ((c & 0xE000) >> 8 | (c & 0x0700) >> 6 | (c & 0x0018) >> 3)
 #define LCD_COLOR_TO_RGB565(c)   ((c & 0xE0) << 8 | (c & 0x1C) << 6 | (c & 0x3) << 3)
 #define LCD_COLOR_FROM_RGB332(c) c
 #define LCD_COLOR_TO_RGB332(c)   c
+#define LCD_FillSpan(p, c, n)    LCD_FillSpan8(p, c, n)
 #elif LCD_COLORBITDEPTH == 16
 #define COLORVAL  uint16_t
+#define PIXELVAL  uint16_t
 #define LCD_BPP   2
 #define LCD_COLOR(r, g, b)       ((r & 0xF8) << 8 | (g & 0xFC) << 3 | (b & 0xF8) >> 3)
 #define LCD_COLOR_FROM_RGB565(c) c
 #define LCD_COLOR_TO_RGB565(c)   c
 #define LCD_COLOR_FROM_RGB332(c) ((c & 0xE0) << 8 | (c & 0x1C) << 6 | (c & 0x3) << 3)
 #define LCD_COLOR_TO_RGB332(c)   ((c & 0xE000) >> 8 | (c & 0x0700) >> 6 | (c & 0x0018) >> 3)
+#define LCD_FillSpan(p, c, n)    LCD_FillSpan16(p, c, n)
 #elif LCD_COLORBITDEPTH == 24
+typedef struct
+{
+  uint8_t b[3];                       /* B, G, R */
+}__attribute__((packed)) LCD_Pixel24;
 #define COLORVAL  uint32_t
+#define PIXELVAL  LCD_Pixel24
 #define LCD_BPP   3
-#define LCD_COLOR(r, g, b)      (r << 16 | g << 8 | b)
+#define LCD_COLOR(r, g, b)       (r << 16 | g << 8 | b)
+#define LCD_COLOR_FROM_RGB565(c) ((c & 0xF800) << 8 | (c & 0xE000) << 3 | (c & 0x07E0) << 5 | (c & 0x0600) >> 1 | (c & 0x001F) << 3 | (c & 0x001C) >> 2)
+#define LCD_COLOR_TO_RGB565(c)   ((c & 0xF80000) >> 8 | (c & 0x00FC00) >> 5 | (c & 0x0000F8) >> 3)
+#define LCD_COLOR_FROM_RGB332(c) ((c & 0xE0) << 16 | (c & 0x1C) << 11 | (c & 0x3) << 6)
+#define LCD_COLOR_TO_RGB332(c)   ((c & 0xE00000) >> 16 | (c & 0x00E000) >> 11 | (c & 0x0000C0) >> 6)
+#define LCD_FillSpan(p, c, n)    LCD_FillSpan24((uint8_t *)(p), c, n)
+#define LCD_PIXEL_WR(p, c)       LCD_Pixel24Wr(p, c)
+#define LCD_PIXEL_RD(p)          LCD_Pixel24Rd(p)
 #elif LCD_COLORBITDEPTH == 32
 #define COLORVAL  uint32_t
+#define PIXELVAL  uint32_t
 #define LCD_BPP   4
-#define LCD_COLOR(r, g, b)      (r << 16 | g << 8 | b)
+#define LCD_COLOR(r, g, b)       (0xFF000000 | r << 16 | g << 8 | b)
+#define LCD_COLOR_ARGB(a, r, g, b) (a << 24 | r << 16 | g << 8 | b)
+#define LCD_COLOR_FROM_RGB565(c) (0xFF000000 | (c & 0xF800) << 8 | (c & 0xE000) << 3 | (c & 0x07E0) << 5 | (c & 0x0600) >> 1 | (c & 0x001F) << 3 | (c & 0x001C) >> 2)
+#define LCD_COLOR_TO_RGB565(c)   ((c & 0xF80000) >> 8 | (c & 0x00FC00) >> 5 | (c & 0x0000F8) >> 3)
+#define LCD_COLOR_FROM_RGB332(c) (0xFF000000 | (c & 0xE0) << 16 | (c & 0x1C) << 11 | (c & 0x3) << 6)
+#define LCD_COLOR_TO_RGB332(c)   ((c & 0xE00000) >> 16 | (c & 0x00E000) >> 11 | (c & 0x0000C0) >> 6)
+#define LCD_FillSpan(p, c, n)    LCD_FillSpan32(p, c, n)
+#endif
+
+#ifndef LCD_PIXEL_WR
+#define LCD_PIXEL_WR(p, c)       *(p) = (c)
+#define LCD_PIXEL_RD(p)          (*(p))
+#endif
+
+/* DMA2D usage (Clear, FillRect, DrawRGB16Image, DrawRGB24Image, DrawBitmap, BlendRect, DrawARGBImage)
+   - 0: not used, the cpu draws everything
+   - 1: DMA2D hardware, the jobs run in the background (see BSP_LCD_Fence)
+   - 2: DMA2D software emulation (the same job path executed by the cpu, for host side tests)
+   note: the image source must stay unchanged until the job is done (BSP_LCD_WaitFence)
+   note: the DMA2D can not reach the DTCM ram (these sources and targets are drawn with the cpu)
+   note: if the D-cache is enabled, the framebuffer must be in a non cacheable region
+   note: it can be set from the compiler command line (the host test builds it with -DLCD_DMA2D=2) */
+#ifndef LCD_DMA2D
+#define LCD_DMA2D                1
+#endif
+
+/* Smaller fills and image copies are drawn with the cpu (the DMA2D setup is not free) */
+#define LCD_DMA2D_MINPIXELS      256
+
+/* BSP_LCD_FillPolygon edge table on the stack up to this vertex count (the bigger polygons use LCD_MALLOC) */
+#define LCD_POLY_EDGES           64
+
+/* Framebuffer number
+   - 1: single buffer (the primitives draw into the displayed buffer)
+   - 2: double buffer (BSP_LCD_SwapBuffers waits for the vertical blank)
+   - 3: triple buffer (BSP_LCD_SwapBuffers returns without waiting for the vertical blank)
+   note: if there is not enough memory for every buffer, less buffers are used */
+#define LCD_BUFFERS              1
+
+/* Line doubling (half memory mode)
+   - 0: disable
+   - 1: the framebuffer has DEF_SIZEY / 2 lines, the LTDC displays every line twice
+   note: BSP_LCD_LineEvent must be called from the LTDC_IRQHandler (the line interrupt steps the
+         layer 1 start address after every second line, the layer line pitch is 0)
+   note: BSP_LCD_GetYSize, the drawing functions and the dirty tiles use the half height
+   note: experimental, not verified on hardware (LCD_LINEDOUBLE_EXPERIMENTAL must be 1 to use it):
+         the line interrupt comes at the start of the second copy of a line, the handler must set
+         the next start address (immediate reload) while this line is displayed and before the LTDC
+         fetches the next line (one line time, 31.7 us at 640x400, minus the interrupt latency).
+         The LTDC interrupt has the highest priority (0), nothing may block it for a line time,
+         else the line is displayed again (the picture slips down by one line until the vertical blank) */
+#define LCD_LINEDOUBLE           0
+#define LCD_LINEDOUBLE_EXPERIMENTAL 0
+
+/* Beam racing strip scanout (no full framebuffer, the LTDC displays a ring of strip buffers)
+   - 0: disable
+   - 1: LTDC line interrupt (BSP_LCD_LineEvent must be called from the LTDC_IRQHandler)
+   - 2: software scanout model (no interrupt, the beam moves one line at every BSP_LCD_LineEvent call
+        and at every wait of BSP_LCD_StripFrame, deterministic timing for host side tests)
+   note: BSP_LCD_StripFrame draws a frame strip by strip with a render callback, it must be called
+         continuously (the strip N + LCD_STRIP_RING - 1 is drawn while the strip N is displayed)
+   note: the drawing functions can be used in the render callback (screen coordinates, clipped to the strip)
+   note: the layer line pitch is 0, the line interrupt sets the start address of every line
+   note: 1 is experimental, not verified on hardware (LCD_STRIPS_EXPERIMENTAL must be 1 to use it):
+         the line interrupt comes at every line (DEF_SIZEY interrupts / frame), the handler must set
+         the next start address (immediate reload) before the LTDC fetches the next line (one line
+         time, 31.7 us at 640x400, minus the interrupt latency). The LTDC interrupt has the highest
+         priority (0), nothing may block it for a line time, else a line is displayed twice
+         (the picture slips down by one line until the vertical blank)
+   note: it can be set from the compiler command line (the host test builds it with -DLCD_STRIPS=2) */
+#ifndef LCD_STRIPS
+#define LCD_STRIPS               0
+#endif
+#define LCD_STRIPS_EXPERIMENTAL  0
+
+/* Strip height (DEF_SIZEY / LCD_STRIP_LINES strips / frame) and the number of the strip buffers */
+#define LCD_STRIP_LINES          40
+#define LCD_STRIP_RING           3
+
+/* Copy the new displayed frame to the new drawing buffer in BSP_LCD_SwapBuffers (0: disable, 1: enable)
+   note: if LCD_DIRTY == 1, only the changed tiles are copied */
+#define LCD_BUFFER_COPY          0
+
+/* Dirty region tracking (every drawing function marks the changed tiles, see BSP_LCD_GetDirtyRects)
+   - 0: disable
+   - 1: enable
+   note: if LCD_BUFFER_COPY == 1, BSP_LCD_SwapBuffers uses and clears the dirty region */
+#define LCD_DIRTY                0
+
+/* Dirty tile size (log2 pixels, 5 and 4: 32 x 16 pixels, the tile columns number max 32) */
+#define LCD_DIRTY_TILEX          5
+#define LCD_DIRTY_TILEY          4
+
+/* LTDC layer 2 overlay (HUD, cursor, sprite above the framebuffer, see BSP_LCD_OverlayInit)
+   - 0: disable
+   - 1: enable
+   note: the LTDC blends the overlay into the picture, moving it is only a window register rewrite
+   note: the overlay buffer have the same rules as the framebuffer (D-cache) */
+#define LCD_OVERLAY              1
+
+#if LCD_COLORBITDEPTH == 8 && LCD_DMA2D == 1
+#undef  LCD_DMA2D
+#define LCD_DMA2D                0  /* the DMA2D have not L8 output color mode */
+#endif
+
+/* Default framebuffer size */
+#define  DEF_SIZEX        640
+#define  DEF_SIZEY        400
+
+/* Framebuffer lines (the drawn height) */
+#if LCD_LINEDOUBLE == 1
+#define  LCD_FB_SIZEY     (DEF_SIZEY / 2)
+#else
+#define  LCD_FB_SIZEY     DEF_SIZEY
+#endif
+
+#if LCD_LINEDOUBLE == 1 && LCD_LINEDOUBLE_EXPERIMENTAL != 1
+#error "LCD_LINEDOUBLE is experimental (the line interrupt timing is not verified), set LCD_LINEDOUBLE_EXPERIMENTAL to 1"
+#endif
+
+#if LCD_STRIPS == 1 && LCD_STRIPS_EXPERIMENTAL != 1
+#error "LCD_STRIPS 1 is experimental (the line interrupt timing is not verified), set LCD_STRIPS_EXPERIMENTAL to 1"
+#endif
+
+#if LCD_STRIPS > 0
+#if LCD_LINEDOUBLE == 1
+#error "LCD_STRIPS and LCD_LINEDOUBLE can not be used together"
+#endif
+#if DEF_SIZEY % LCD_STRIP_LINES || LCD_STRIP_LINES < 2 || LCD_STRIP_RING < 2
+#error "LCD_STRIP_LINES must divide DEF_SIZEY (min 2 lines, min 2 strip buffers)"
+#endif
+#undef  LCD_BUFFERS
+#define LCD_BUFFERS              1  /* there is no full framebuffer */
+#undef  LCD_DIRTY
+#define LCD_DIRTY                0
+#endif
+
+#if LCD_DIRTY == 1
+#define LCD_DIRTY_ROWS    ((LCD_FB_SIZEY + (1 << LCD_DIRTY_TILEY) - 1) >> LCD_DIRTY_TILEY)
+#if DEF_SIZEX > (32 << LCD_DIRTY_TILEX)
+#error "LCD_DIRTY_TILEX is too small for DEF_SIZEX (max 32 tile columns)"
+#endif
 #endif
   
 /** 
@@ -107,9 +292,49 @@ typedef struct
 {
   uint16_t SizeX;
   uint16_t SizeY;
-  volatile COLORVAL *pixels;
+  volatile PIXELVAL *pixels;
+  uint16_t Stride;                 /* pixels / line */
+  #if LCD_DIRTY == 1
+  uint32_t dirty[LCD_DIRTY_ROWS];  /* dirty tiles (1 word / tile row, 1 bit / tile) */
+  #endif
 }LCD_FrameBuffer;
 
+/** 
+  * @brief  Surface (drawing target) definition
+  *         the pixel format is always the framebuffer format (Format = LCD_COLORBITDEPTH)
+  */
+typedef struct
+{
+  PIXELVAL *pixels;
+  uint16_t SizeX;
+  uint16_t SizeY;
+  uint16_t Stride;                 /* pixels / line (a sub-surface view has the parent stride) */
+  uint8_t  Format;
+}LCD_SurfaceTypeDef;
+
+/** 
+  * @brief  Strip render callback (LCD_STRIPS: draws Lines lines from the Ypos line, pPixels: the first line
+  *         of the strip buffer, DEF_SIZEX pixels / line)
+  */
+typedef void (*LCD_StripRenderTypeDef)(PIXELVAL *pPixels, uint16_t Ypos, uint16_t Lines);
+
+#if LCD_COLORBITDEPTH == 24
+/**
+  * @brief  Packed 24 bits/pixel access (COLORVAL 0x00RRGGBB <-> 3 bytes)
+  */
+static inline void LCD_Pixel24Wr(volatile LCD_Pixel24 *p, uint32_t c)
+{
+  p->b[0] = c;
+  p->b[1] = c >> 8;
+  p->b[2] = c >> 16;
+}
+
+static inline uint32_t LCD_Pixel24Rd(volatile const LCD_Pixel24 *p)
+{
+  return p->b[0] | p->b[1] << 8 | p->b[2] << 16;
+}
+#endif
+
 /**
   * @brief  Draw Properties structures definition
   */ 
@@ -118,6 +343,8 @@ typedef struct
   COLORVAL TextColor;
   COLORVAL BackColor;
   sFONT    *pFont; 
+  uint8_t  TextMode;
+  uint8_t  FillRule;
 }LCD_DrawPropTypeDef;
 
 /** 
@@ -129,6 +356,17 @@ typedef struct
   int16_t Y;
 }Point, * pPoint;
 
+/** 
+  * @brief  Rectangle structures definition
+  */ 
+typedef struct 
+{
+  uint16_t X;
+  uint16_t Y;
+  uint16_t Width;
+  uint16_t Height;
+}LCD_RectTypeDef;
+
 /** 
   * @brief  Line mode structures definition
   */ 
@@ -138,6 +376,32 @@ typedef enum
   RIGHT_MODE              = 0x02,    /*!< Right mode  */
   LEFT_MODE               = 0x03     /*!< Left mode   */
 }Line_ModeTypdef;
+
+/** 
+  * @brief  Text background mode
+  */
+#define LCD_TEXT_OPAQUE        0     /* the background pixels are drawn with the back color */
+#define LCD_TEXT_TRANSPARENT   1     /* the background pixels are not drawn */
+
+/** 
+  * @brief  Polygon fill rule
+  */
+#define LCD_FILL_NONZERO       0     /* inside: the edge winding number is not zero */
+#define LCD_FILL_EVENODD       1     /* inside: odd number of edge crossings */
+
+/** 
+  * @brief  BSP_LCD_DrawARGBImage source formats (the DMA2D color mode codes)
+  */
+#define LCD_ARGB8888   0     /* 32 bits/pixel (0xAARRGGBB) */
+#define LCD_ARGB4444   4     /* 16 bits/pixel (0xARGB) */
+#define LCD_A8         9     /* 8 bits/pixel alpha only, the color is the text color */
+
+/** 
+  * @brief  Overlay (LTDC layer 2) pixel formats (the LTDC_LxPFCR codes)
+  */
+#define LCD_OVERLAY_ARGB4444   4     /* 16 bits/pixel (0xARGB) */
+#define LCD_OVERLAY_L8         5     /* 8 bits/pixel palette index (256 entries, opaque, see color key) */
+#define LCD_OVERLAY_AL44       6     /* 8 bits/pixel (0xAI: 4 bits alpha, 4 bits palette index) */
  
 #define __IO    volatile  
 
@@ -174,6 +438,13 @@ void     BSP_LCD_SetTextColor(__IO COLORVAL Color);
 void     BSP_LCD_SetBackColor(__IO COLORVAL Color);
 void     BSP_LCD_SetFont(sFONT *fonts);
 sFONT    *BSP_LCD_GetFont(void);
+void     BSP_LCD_SetTextMode(uint8_t Mode);
+uint8_t  BSP_LCD_GetTextMode(void);
+void     BSP_LCD_SetFillRule(uint8_t Rule);
+uint8_t  BSP_LCD_GetFillRule(void);
+void     BSP_LCD_SetClipRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height);
+void     BSP_LCD_ResetClipRect(void);
+void     BSP_LCD_GetClipRect(LCD_RectTypeDef *pRect);
 
 void     BSP_LCD_Clear(COLORVAL Color);
 void     BSP_LCD_ClearStringLine(uint16_t Line);
@@ -196,24 +467,90 @@ void     BSP_LCD_FillPolygon(pPoint Points, uint16_t PointCount);
 void     BSP_LCD_FillEllipse(uint16_t Xpos, uint16_t Ypos, uint16_t XRadius, uint16_t YRadius);
 void     BSP_LCD_FillTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3);
 
+/* Anti-aliased outlines (blended into the framebuffer with the text color) */
+void     BSP_LCD_DrawLineAA(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+void     BSP_LCD_DrawCircleAA(uint16_t Xpos, uint16_t Ypos, uint16_t Radius);
+void     BSP_LCD_DrawEllipseAA(uint16_t Xpos, uint16_t Ypos, uint16_t XRadius, uint16_t YRadius);
+void     BSP_LCD_DrawPolygonAA(pPoint Points, uint16_t PointCount);
+
+/* Alpha blending (Alpha: 0 = transparent .. 255 = opaque, the cpu blends with 5 bits alpha) */
+void     BSP_LCD_BlendRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height, COLORVAL Color, uint8_t Alpha);
+void     BSP_LCD_DrawARGBImage(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16_t Ysize, const void *pData, uint32_t Format);
+
+/* Surfaces (the drawing functions draw into the selected target, NULL: the screen) */
+uint8_t  BSP_LCD_InitSurface(LCD_SurfaceTypeDef *pSurface, void *pPixels, uint16_t Width, uint16_t Height, uint16_t Stride);
+LCD_SurfaceTypeDef *BSP_LCD_CreateSurface(uint16_t Width, uint16_t Height);
+void     BSP_LCD_DeleteSurface(LCD_SurfaceTypeDef *pSurface);
+uint8_t  BSP_LCD_SubSurface(LCD_SurfaceTypeDef *pView, const LCD_SurfaceTypeDef *pParent, uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height);
+uint8_t  BSP_LCD_SelectTarget(LCD_SurfaceTypeDef *pSurface);
+LCD_SurfaceTypeDef *BSP_LCD_GetTarget(void);
+void     BSP_LCD_DrawSurface(uint16_t Xpos, uint16_t Ypos, const LCD_SurfaceTypeDef *pSurface);
+
+/* LTDC layer 2 overlay (Color: the overlay pixel value, Rgb: 0xRRGGBB) */
+uint8_t  BSP_LCD_OverlayInit(void *pPixels, uint16_t Width, uint16_t Height, uint8_t Format);
+void     BSP_LCD_OverlayShow(uint8_t Show);
+void     BSP_LCD_OverlayMove(int16_t Xpos, int16_t Ypos);
+void     BSP_LCD_OverlaySetAlpha(uint8_t Alpha);
+void     BSP_LCD_OverlaySetColorKey(uint32_t Rgb);
+void     BSP_LCD_OverlayResetColorKey(void);
+void     BSP_LCD_OverlaySetPalette(uint32_t Index, uint32_t Count, const uint32_t *pRgb);
+void     BSP_LCD_OverlayFillRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height, uint32_t Color);
+void     BSP_LCD_OverlayDisplayStringAt(uint16_t Xpos, uint16_t Ypos, uint8_t *Text, uint32_t TextColor, uint32_t BackColor);
+
 void     BSP_LCD_DisplayOff(void);
 void     BSP_LCD_DisplayOn(void);
 
+uint8_t  BSP_LCD_SwapBuffers(void);
+void     BSP_LCD_LineEvent(void);
+
+/* Beam racing strip scanout (LCD_STRIPS) */
+void     BSP_LCD_StripFrame(LCD_StripRenderTypeDef Render);
+uint32_t BSP_LCD_StripLate(void);
+
+/* Palette (8 bits/pixel: the LTDC CLUT, the set functions wait for the vertical blank, Rgb: 0xRRGGBB) */
+void     BSP_LCD_SetPalette(uint32_t Index, uint32_t Count, const uint32_t *pRgb);
+void     BSP_LCD_GetPalette(uint32_t Index, uint32_t Count, uint32_t *pRgb);
+void     BSP_LCD_CyclePalette(uint32_t Index, uint32_t Count, int32_t Step);
+void     BSP_LCD_FadePalette(uint32_t Index, uint32_t Count, const uint32_t *pRgb, uint32_t Rgb, uint8_t Level);
+COLORVAL BSP_LCD_ColorFromRgb(uint32_t Rgb);
+uint32_t BSP_LCD_ColorToRgb(COLORVAL Color);
+
+/* Dirty region (the changed tiles since the last BSP_LCD_ClearDirty) */
+void     BSP_LCD_SetDirty(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height);
+void     BSP_LCD_ClearDirty(void);
+uint8_t  BSP_LCD_GetDirtyRect(LCD_RectTypeDef *pRect);
+uint32_t BSP_LCD_GetDirtyRects(LCD_RectTypeDef *pRects, uint32_t MaxRects);
+
+/* Span fill kernels (fill Length pixels from p with Color, p can be any pixel buffer)
+   - LCD_FillSpan24 : packed 3 bytes/pixel (B, G, R byte order) */
+void     LCD_FillSpan8(uint8_t *p, uint8_t Color, uint32_t Length);
+void     LCD_FillSpan16(uint16_t *p, uint16_t Color, uint32_t Length);
+void     LCD_FillSpan24(uint8_t *p, uint32_t Color, uint32_t Length);
+void     LCD_FillSpan32(uint32_t *p, uint32_t Color, uint32_t Length);
+
+/* Two RGB565 pixels (in one word) blend kernel: Fg * Alpha / 32 + Bg * (32 - Alpha) / 32 */
+uint32_t LCD_Blend565x2(uint32_t Fg, uint32_t Bg, uint32_t Alpha);
+
+/* DMA2D jobs fence (if LCD_DMA2D == 0 every fence is always done) */
+uint32_t BSP_LCD_Fence(void);
+uint8_t  BSP_LCD_FenceDone(uint32_t Fence);
+void     BSP_LCD_WaitFence(uint32_t Fence);
+void     BSP_LCD_Sync(void);
+
 #ifdef   LCD_DRVTYPE_V1_1
 uint16_t BSP_LCD_ReadID(void);
 COLORVAL BSP_LCD_ReadPixel(uint16_t Xpos, uint16_t Ypos);
 void     BSP_LCD_DrawRGB16Image(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16_t Ysize, uint16_t *pData);
 void     BSP_LCD_ReadRGB16Image(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16_t Ysize, uint16_t *pData);
+void     BSP_LCD_DrawRGB24Image(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16_t Ysize, uint8_t *pData);
 #endif
 
-/* Default framebuffer size */
-#define  DEF_SIZEX        640
-#define  DEF_SIZEY        400
-
 /* include for memory alloc/free */
 #include "multi_heap_4.h"
 #define  LCD_MALLOC       d1Malloc
 #define  LCD_FREE         d1Free
+/* memory alloc for the 2nd and 3rd framebuffer if LCD_MALLOC is full (if not used: leave it that way) */
+#define  LCD_MALLOC2      d2Malloc
  
 #ifdef __cplusplus
 }
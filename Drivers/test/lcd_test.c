@@ -0,0 +1,231 @@
+/*
+ * Host side tests of the framebuffer driver (make -C Drivers/test)
+ * - LCD_FillSpan8/16/24/32: word wide span fill kernels against the per pixel fill
+ *   (every start alignment and length, the bytes around the span must stay unchanged)
+ * - LCD_DMA2D == 2: the DMA2D emulation against the cpu path, every job is drawn once as a whole
+ *   (DMA2D) and once line by line below LCD_DMA2D_MINPIXELS (cpu), the framebuffers must be equal
+ * - LCD_STRIPS == 2: the software scanout model of the beam racing strip renderer (lcd_test_strips),
+ *   no late strip if the render keeps up with the beam (the cleared startup frame is not late),
+ *   late strips and skipped renders if it does not
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+#include "stm32_adafruit_lcd_fb.h"
+
+/* the peripheral registers of main.h */
+LTDC_TypeDef       HostLtdc;
+LTDC_Layer_TypeDef HostLayer1, HostLayer2;
+DMA2D_TypeDef      HostDma2d;
+RCC_TypeDef        HostRcc;
+
+static uint32_t Errors = 0;
+
+#define CHECK(cond, ...)  {if(!(cond)) {Errors++; printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n");}}
+
+static uint32_t RandSeed = 12345;
+static uint32_t Rand(void)
+{
+  RandSeed = RandSeed * 1103515245 + 12345;
+  return RandSeed >> 8;
+}
+
+/* span fill kernels ---------------------------------------------------------*/
+#define SPAN_MAX         160
+#define SPAN_GUARD       16
+
+static void TestSpans(void)
+{
+  static uint32_t buf[(SPAN_MAX * 4 + 2 * SPAN_GUARD) / 4], ref[(SPAN_MAX * 4 + 2 * SPAN_GUARD) / 4];
+  uint8_t *pb, *pr;
+  uint32_t bpp, ofs, len, i, c;
+
+  for(bpp = 1; bpp <= 4; bpp++)
+    for(ofs = 0; ofs < 8; ofs++)
+      for(len = 0; len <= SPAN_MAX; len++)
+      {
+        c = Rand();
+        memset(buf, 0xA5, sizeof(buf));
+        memset(ref, 0xA5, sizeof(ref));
+        /* 16 and 32 bits/pixel: the pixels are aligned to their size */
+        pb = (uint8_t *)buf + SPAN_GUARD + (bpp == 2 || bpp == 4 ? ofs * bpp % 8 : ofs);
+        pr = (uint8_t *)ref + (pb - (uint8_t *)buf);
+        for(i = 0; i < len; i++)
+          if(bpp == 1)
+            pr[i] = (uint8_t)c;
+          else if(bpp == 2)
+            ((uint16_t *)pr)[i] = (uint16_t)c;
+          else if(bpp == 3)
+          {
+            pr[3 * i + 0] = c;
+            pr[3 * i + 1] = c >> 8;
+            pr[3 * i + 2] = c >> 16;
+          }
+          else
+            ((uint32_t *)pr)[i] = c;
+        if(bpp == 1)
+          LCD_FillSpan8(pb, c, len);
+        else if(bpp == 2)
+          LCD_FillSpan16((uint16_t *)pb, c, len);
+        else if(bpp == 3)
+          LCD_FillSpan24(pb, c, len);
+        else
+          LCD_FillSpan32((uint32_t *)pb, c, len);
+        CHECK(!memcmp(buf, ref, sizeof(buf)), "LCD_FillSpan%u offset %u length %u", (unsigned)bpp * 8, (unsigned)ofs, (unsigned)len);
+      }
+}
+
+/* DMA2D emulation ----------------------------------------------------------*/
+#if LCD_DMA2D == 2 && LCD_STRIPS == 0
+extern LCD_FrameBuffer fb;
+
+#define IMG_X            200   /* below LCD_DMA2D_MINPIXELS */
+#define IMG_Y            120
+
+enum {JOB_CLEAR, JOB_FILLRECT, JOB_BLENDRECT, JOB_RGB16IMAGE, JOB_ARGBIMAGE, JOB_NUM};
+static const char *JobName[JOB_NUM] = {"Clear", "FillRect", "BlendRect", "DrawRGB16Image", "DrawARGBImage"};
+
+static uint16_t Img16[IMG_X * IMG_Y];
+static uint32_t Img32[IMG_X * IMG_Y];
+
+/* draws the job (Line < 0: whole, else only its line Line), 1 = the job has this line */
+static int DrawJob(int Job, int x, int y, int w, int h, COLORVAL c, uint8_t a, int Line)
+{
+  int y1 = Line < 0 ? y : y + Line, n = Line < 0 ? h : 1;
+  if(Job == JOB_CLEAR)                /* line by line: pixel by pixel (a screen line is DMA2D size) */
+  {
+    if(Line >= (int)fb.SizeY)
+      return 0;
+    if(Line < 0)
+      BSP_LCD_Clear(c);
+    else
+      for(x = 0; x < (int)fb.SizeX; x++)
+        BSP_LCD_DrawPixel(x, Line, c);
+    return 1;
+  }
+  if(Line >= h)
+    return 0;
+  switch(Job)
+  {
+    case JOB_FILLRECT:
+      BSP_LCD_SetTextColor(c);
+      BSP_LCD_FillRect(x, y1, w, n);
+      break;
+    case JOB_BLENDRECT:
+      BSP_LCD_BlendRect(x, y1, w, n, c, a);
+      break;
+    case JOB_RGB16IMAGE:
+      BSP_LCD_DrawRGB16Image(x, y1, w, n, &Img16[(y1 - y) * w]);
+      break;
+    case JOB_ARGBIMAGE:
+      BSP_LCD_DrawARGBImage(x, y1, w, n, &Img32[(y1 - y) * w], LCD_ARGB8888);
+      break;
+  }
+  return 1;
+}
+
+static void TestDma2d(void)
+{
+  uint32_t size, i, f;
+  PIXELVAL *bg, *ref;
+  int job, x, y, w, h, l;
+  COLORVAL c;
+  uint8_t a;
+
+  BSP_LCD_Init();
+  size = fb.Stride * fb.SizeY * sizeof(PIXELVAL);
+  bg = malloc(size);
+  ref = malloc(size);
+  for(i = 0; i < size / sizeof(PIXELVAL); i++)
+    bg[i] = Rand();
+  for(i = 0; i < IMG_X * IMG_Y; i++)
+  {
+    Img16[i] = Rand();
+    Img32[i] = Rand() << 8 | (Rand() & 0xFF);
+  }
+  for(i = 0; i < 500; i++)
+  {
+    job = i % JOB_NUM;
+    /* one line is drawn with the cpu (w < LCD_DMA2D_MINPIXELS), the whole job with the DMA2D */
+    w = 3 + Rand() % (IMG_X - 2);
+    h = (LCD_DMA2D_MINPIXELS + w - 1) / w + Rand() % 40;
+    if(h > IMG_Y)
+      h = IMG_Y;
+    x = Rand() % (fb.SizeX - w + 1);
+    y = Rand() % (fb.SizeY - h + 1);
+    c = Rand();
+    a = 1 + Rand() % 255;              /* 0: nothing is drawn */
+
+    memcpy((void *)fb.pixels, bg, size);
+    for(l = 0; DrawJob(job, x, y, w, h, c, a, l); l++);
+    BSP_LCD_Sync();
+    memcpy(ref, (void *)fb.pixels, size);
+
+    memcpy((void *)fb.pixels, bg, size);
+    f = BSP_LCD_Fence();
+    DrawJob(job, x, y, w, h, c, a, -1);
+    CHECK(BSP_LCD_Fence() != f, "%s: not drawn with the DMA2D", JobName[job]);
+    BSP_LCD_WaitFence(BSP_LCD_Fence());
+    CHECK(!memcmp(ref, (void *)fb.pixels, size), "%s %d %d %d %d: the DMA2D emulation differs from the cpu", JobName[job], x, y, w, h);
+  }
+  free(bg);
+  free(ref);
+}
+#endif
+
+/* strip scanout -------------------------------------------------------------*/
+#if LCD_STRIPS == 2
+#define STRIPS_FRAME     (DEF_SIZEY / LCD_STRIP_LINES)
+#define STRIPS_FRAMES    50
+
+static uint32_t StripCalls, StripDelay;
+
+/* render callback: fills the strip with its Y position, then the beam moves StripDelay lines */
+static void StripRender(PIXELVAL *pPixels, uint16_t Ypos, uint16_t Lines)
+{
+  uint32_t i;
+  StripCalls++;
+  CHECK(Ypos % LCD_STRIP_LINES == 0 && Ypos < DEF_SIZEY && Lines == LCD_STRIP_LINES, "strip render %u %u", Ypos, Lines);
+  BSP_LCD_SetTextColor(Ypos);
+  BSP_LCD_FillRect(0, 0, DEF_SIZEX, DEF_SIZEY);  /* clipped to the strip */
+  BSP_LCD_Sync();
+  CHECK(pPixels[0] == Ypos && pPixels[DEF_SIZEX * Lines - 1] == Ypos, "strip %u is not drawn", Ypos);
+  for(i = 0; i < StripDelay; i++)
+    BSP_LCD_LineEvent();
+}
+
+static void TestStrips(void)
+{
+  uint32_t f, late;
+
+  BSP_LCD_Init();
+  StripDelay = 0;                     /* faster than the beam */
+  for(f = 0; f < STRIPS_FRAMES; f++)
+    BSP_LCD_StripFrame(StripRender);
+  late = BSP_LCD_StripLate();
+  CHECK(StripCalls == STRIPS_FRAMES * STRIPS_FRAME, "fast render: %u strips drawn", (unsigned)StripCalls);
+  CHECK(late == 0, "fast render: %u late strips", (unsigned)late);
+
+  StripCalls = 0;
+  StripDelay = LCD_STRIP_LINES * 3 / 2; /* slower than the beam */
+  for(f = 0; f < STRIPS_FRAMES; f++)
+    BSP_LCD_StripFrame(StripRender);
+  late = BSP_LCD_StripLate();
+  CHECK(StripCalls < STRIPS_FRAMES * STRIPS_FRAME, "slow render: %u strips drawn (no skipped strip)", (unsigned)StripCalls);
+  CHECK(late > 0, "slow render: no late strip");
+}
+#endif
+
+int main(void)
+{
+  TestSpans();
+  #if LCD_DMA2D == 2 && LCD_STRIPS == 0
+  TestDma2d();
+  #endif
+  #if LCD_STRIPS == 2
+  TestStrips();
+  #endif
+  printf("%s: %u errors\n", Errors ? "FAILED" : "OK", (unsigned)Errors);
+  return Errors != 0;
+}
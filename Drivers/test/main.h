@@ -0,0 +1,24 @@
+/* Host stand-in of the STM32 main.h for the driver tests: the device header gives the register
+   types, the peripherals are plain structures in the host memory (lcd_test.c) */
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdint.h>
+#include "stm32h7xx.h"
+
+#undef  LTDC
+#undef  LTDC_Layer1
+#undef  LTDC_Layer2
+#undef  DMA2D
+#undef  RCC
+extern LTDC_TypeDef       HostLtdc;
+extern LTDC_Layer_TypeDef HostLayer1, HostLayer2;
+extern DMA2D_TypeDef      HostDma2d;
+extern RCC_TypeDef        HostRcc;
+#define LTDC              (&HostLtdc)
+#define LTDC_Layer1       (&HostLayer1)
+#define LTDC_Layer2       (&HostLayer2)
+#define DMA2D             (&HostDma2d)
+#define RCC               (&HostRcc)
+
+#endif /* __MAIN_H */
@@ -0,0 +1,12 @@
+/* Host stand-in of the multi region heap for the driver tests */
+#ifndef __MULTI_HEAP_4_H_
+#define __MULTI_HEAP_4_H_
+
+#include <stdlib.h>
+
+#define d1Malloc(size)   malloc(size)
+#define d1Free(p)        free(p)
+#define d2Malloc(size)   malloc(size)
+#define d2Free(p)        free(p)
+
+#endif /* __MULTI_HEAP_4_H_ */
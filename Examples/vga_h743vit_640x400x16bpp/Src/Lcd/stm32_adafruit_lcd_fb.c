@@ -13,6 +13,31 @@
  * - Add : BSP_LCD_ReadRGB16Image
  * - Add : BSP_LCD_FillTriangle (faster algorithm)
  * - Modify : BSP_LCD_Init (default font from header file, default colors from header file, otptional clear from header file)
+ * - Add : LCD_FillSpan8/16/24/32 (word wide span fill, Clear / FillRect / DrawHLine use it)
+ * - Add : DMA2D background jobs (Clear, FillRect, DrawRGB16Image, DrawBitmap), BSP_LCD_Fence...
+ * - Add : BSP_LCD_SwapBuffers (double / triple buffering)
+ * - Add : dirty tiles tracking (BSP_LCD_GetDirtyRects...), BSP_LCD_SwapBuffers copy only the dirty tiles
+ * - Add : clip rectangle (BSP_LCD_SetClipRect...), every drawing function is clipped
+ * - Modify : BSP_LCD_DrawLine (run slice), BSP_LCD_DrawCircle, BSP_LCD_DrawEllipse, BSP_LCD_FillEllipse
+ *            (index stepping, integer only, the same pixels)
+ * - Add : BSP_LCD_DrawLineAA, BSP_LCD_DrawCircleAA, BSP_LCD_DrawEllipseAA, BSP_LCD_DrawPolygonAA
+ * - Add : BSP_LCD_BlendRect, BSP_LCD_DrawARGBImage (cpu: SWAR blend, DMA2D: memory to memory with blending)
+ * - Add : BSP_LCD_SetTextMode, BSP_LCD_GetTextMode (transparent text background)
+ * - Modify : 24 bits/pixel packed framebuffer (the pixels are accessed with LCD_PIXEL_WR / LCD_PIXEL_RD),
+ *            BSP_LCD_Init sets the LTDC layer pixel format and line length from LCD_COLORBITDEPTH
+ * - Add : BSP_LCD_DrawRGB24Image
+ * - Modify : DrawChar (glyph rows: nibble -> 4 pixels lookup table or text color runs),
+ *            BSP_LCD_DisplayStringAt (the whole string row at once)
+ * - Add : surfaces and sub-surface views as drawing target (BSP_LCD_SelectTarget...), the pixel addresses
+ *         use the line stride (fb.Stride)
+ * - Modify : BSP_LCD_FillPolygon (active edge table scanline fill, BSP_LCD_SetFillRule: non-zero / even-odd)
+ * - Modify : BSP_LCD_FillTriangle (edge stepping without division), BSP_LCD_FillCircle, BSP_LCD_FillEllipse
+ *            (every line is drawn once, the same pixels)
+ * - Add : LTDC layer 2 overlay (BSP_LCD_OverlayInit...), the window is moved with the layer registers
+ * - Add : 8 bits/pixel palette (BSP_LCD_SetPalette, BSP_LCD_CyclePalette, BSP_LCD_FadePalette...),
+ *         BSP_LCD_ColorFromRgb, BSP_LCD_ColorToRgb
+ * - Add : line doubling (LCD_LINEDOUBLE: half height framebuffer, LTDC line interrupt, BSP_LCD_LineEvent)
+ * - Add : beam racing strip scanout (LCD_STRIPS: ring of strip buffers, BSP_LCD_StripFrame, BSP_LCD_StripLate)
  * */
 
 /**
@@ -63,6 +88,7 @@ EndDependencies */
     
 /* Includes ------------------------------------------------------------------*/
 #include <stdlib.h>
+#include <string.h>
 #include "main.h"
 #include "lcd.h"
 #include "bmp.h"
@@ -73,15 +99,184 @@ EndDependencies */
 #define POLY_X(Z)             ((int32_t)((Points + (Z))->X))
 #define POLY_Y(Z)             ((int32_t)((Points + (Z))->Y))
 
+#if LCD_DMA2D > 0
+/* DMA2D modes (CR) and color modes (FGPFCCR, OPFCCR) */
+#define DMA2D_MODE_M2M_PFC    (1 << 16)
+#define DMA2D_MODE_M2M_BLEND  (2 << 16)
+#define DMA2D_MODE_R2M        (3 << 16)
+#define DMA2D_CM_ARGB8888     0
+#define DMA2D_CM_RGB888       1
+#define DMA2D_CM_RGB565       2
+#define DMA2D_CM_ARGB4444     4
+#define DMA2D_CM_A8           9
+#define DMA2D_AM_REPLACE      (1 << 16)
+#if   LCD_COLORBITDEPTH == 16
+#define DMA2D_CM_OUTPUT       DMA2D_CM_RGB565
+#define DMA2D_COLOR(c)        ((c & 0xF800) << 8 | (c & 0x07E0) << 5 | (c & 0x001F) << 3)
+#elif LCD_COLORBITDEPTH == 24
+#define DMA2D_CM_OUTPUT       DMA2D_CM_RGB888
+#define DMA2D_COLOR(c)        (c & 0xFFFFFF)
+#else
+#define DMA2D_CM_OUTPUT       DMA2D_CM_ARGB8888
+#define DMA2D_COLOR(c)        (c & 0xFFFFFF)
+#endif
+#if   LCD_DMA2D == 1
+/* the DMA2D can not reach the DTCM ram (0x20000000..0x2001FFFF): such sources and targets are drawn with the cpu */
+#define DMA2D_ADDRESSABLE(a)  ((uint32_t)(uintptr_t)(a) - 0x20000000 >= 0x20000)
+#else
+#define DMA2D_ADDRESSABLE(a)  1
+#endif
+#endif
+
+/* LTDC layer pixel format (LTDC_LxPFCR: 0 = ARGB8888, 1 = RGB888, 2 = RGB565, 5 = L8) */
+#if   LCD_COLORBITDEPTH == 8
+#define LCD_LTDC_PF           5
+#elif LCD_COLORBITDEPTH == 16
+#define LCD_LTDC_PF           2
+#elif LCD_COLORBITDEPTH == 24
+#define LCD_LTDC_PF           1
+#else
+#define LCD_LTDC_PF           0
+#endif
+
 /* @defgroup STM32_ADAFRUIT_LCD_Private_Macros */
 #define ABS(X) ((X) > 0 ? (X) : -(X))
-#define SWAP16(a, b) {uint16_t t = a; a = b; b = t;}
+#define SWAP16(a, b) {int16_t t = a; a = b; b = t;}
+
+/* @defgroup STM32_ADAFRUIT_LCD_Private_Types */
+/* word access to the 8/16 bits pixel buffers (no strict aliasing problem) */
+typedef uint32_t __attribute__((may_alias)) uint32a_t;
+typedef uint64_t __attribute__((may_alias)) uint64a_t;
+
+/* 4 pixels of a glyph row (the glyph lookup table entry) */
+typedef struct
+{
+  PIXELVAL c[4];
+}GlyphQuadTypeDef;
+
+/* ellipse x scale stepper: x / K (K = YRadius / XRadius as float) without float */
+typedef struct
+{
+  uint32_t a, b;            /* 1 / K = a + b / m */
+  uint32_t m;               /* K mantissa (24 bits) */
+  uint32_t p;               /* the greatest power of 2 <= f */
+  uint32_t f, rem;          /* x / K = f + rem / m */
+}EllipseStepTypeDef;
+
+/* triangle edge x stepper: x0 + dx * n / dy (rounded toward zero) of the line n without division */
+typedef struct
+{
+  int32_t x;                /* crossing x of the current line */
+  int32_t q, r;             /* x step / line (signed), |dx| % dy */
+  int32_t rem, dy;          /* |dx| * n % dy */
+  int8_t  dir;              /* sign of dx */
+}TriEdgeTypeDef;
+
+/* polygon fill edge (from the upper point, the lines y1..y2 have crossing)
+   rounded crossing x stepping with error term, until the edge is active: x = upper x, dx = x difference, ey = height */
+typedef struct
+{
+  int32_t x, ex;            /* crossing x of the current line, error term (0 .. ey - 1) */
+  int32_t dx, edx, ey;      /* x step / line, error step / line, error limit (2 * height) */
+  int16_t y1, y2;
+  int8_t  dir;              /* winding: 1 downward, -1 upward */
+}PolyEdgeTypeDef;
 
 /* @defgroup STM32_ADAFRUIT_LCD_Private_Variables */ 
 LCD_DrawPropTypeDef DrawProp;
 
+/* text: glyph row nibble (MSB first) -> 4 pixels with the text and back color */
+static GlyphQuadTypeDef GlyphLut[16];
+static COLORVAL GlyphLutFg, GlyphLutBg;
+static uint8_t  GlyphLutValid = 0;
+
+/* anti-aliasing: coverage (6 bits) -> alpha (0..32), slightly sharpened, a[i] + a[63 - i] = 32 */
+static const uint8_t AaCoverage[64] =
+{ 0,  0,  1,  1,  1,  2,  2,  2,  3,  3,  4,  4,  5,  5,  6,  6,
+  7,  7,  8,  8,  9, 10, 10, 11, 11, 12, 13, 13, 14, 14, 15, 16,
+ 16, 17, 18, 18, 19, 19, 20, 21, 21, 22, 22, 23, 24, 24, 25, 25,
+ 26, 26, 27, 27, 28, 28, 29, 29, 30, 30, 30, 31, 31, 31, 32, 32};
+
+/* clip rectangle (inclusive limits, the drawing functions draw only inside) */
+static struct
+{
+  int32_t x1, y1, x2, y2;
+}Clip;
+
+/* DMA2D jobs: started job counter (the fence) and the last job may be still running */
+static uint32_t Dma2dSeq = 0;
+#if LCD_DMA2D > 0
+static uint8_t  Dma2dBusy = 0;
+
+/* the cpu must wait for the background job before touching the framebuffer */
+#define LCD_SYNC()            if(Dma2dBusy) Dma2d_Wait()
+#else
+#define LCD_SYNC()
+#endif
+
+#if LCD_DIRTY == 1
+/* the dirty tiles are the screen tiles (0: an other surface is the drawing target) */
+static uint8_t  DirtyOn = 1;
+
+/* mark the changed tiles (the coordinates are already clipped) */
+#define DIRTY_PIXEL(x, y)     if(!DirtyOn) ; else fb.dirty[(y) >> LCD_DIRTY_TILEY] |= 1u << ((x) >> LCD_DIRTY_TILEX)
+#define DIRTY_HSPAN(x1, x2, y) if(!DirtyOn) ; else fb.dirty[(y) >> LCD_DIRTY_TILEY] |= (2u << ((x2) >> LCD_DIRTY_TILEX)) - (1u << ((x1) >> LCD_DIRTY_TILEX))
+#define DIRTY_VSPAN(x, y1, y2) if(!DirtyOn) ; else for(uint32_t t = (y1) >> LCD_DIRTY_TILEY; t <= (uint32_t)(y2) >> LCD_DIRTY_TILEY; t++) fb.dirty[t] |= 1u << ((x) >> LCD_DIRTY_TILEX)
+#define DIRTY_RECT(x, y, w, h) if(!DirtyOn) ; else BSP_LCD_SetDirty(x, y, w, h)
+#else
+#define DIRTY_PIXEL(x, y)
+#define DIRTY_HSPAN(x1, x2, y)
+#define DIRTY_VSPAN(x, y1, y2)
+#define DIRTY_RECT(x, y, w, h)
+#endif
+
+/* pixel write to fb.pixels[i] (i: index of the (x, y) point), with clipping if the shape is not fully visible */
+#define CLIP_PIXEL(i, x, y, c, clip)                                        \
+  if(!(clip) || ((x) >= Clip.x1 && (x) <= Clip.x2 && (y) >= Clip.y1 && (y) <= Clip.y2)) \
+  {                                                                         \
+    LCD_PIXEL_WR(&fb.pixels[i], c);                                         \
+    DIRTY_PIXEL(x, y);                                                      \
+  }
+
 /* @defgroup STM32_ADAFRUIT_LCD_Private_FunctionPrototypes */ 
 static void DrawChar(uint16_t Xpos, uint16_t Ypos, const uint8_t *c);
+static void DrawString(int32_t Xpos, int32_t Ypos, const uint8_t *Text, uint32_t Count);
+static void GlyphLutUpdate(void);
+static void GlyphRow(PIXELVAL *p, uint32_t Bits, uint32_t Length);
+static void DrawCircleWrap(uint16_t Xpos, uint16_t Ypos, uint16_t Radius);
+static void EllipseStepInit(EllipseStepTypeDef *e, uint32_t XRadius, uint32_t YRadius);
+static uint32_t EllipseStep(EllipseStepTypeDef *e);
+static void FillCircleLines(uint16_t Xpos, uint16_t Ypos, uint32_t Dy, uint32_t Dx);
+static inline void TriEdgeInit(TriEdgeTypeDef *e, int32_t x0, int32_t dx, int32_t dy, uint32_t n);
+static inline void TriEdgeStep(TriEdgeTypeDef *e);
+static COLORVAL BlendColor(COLORVAL Fg, COLORVAL Bg, uint32_t Alpha);
+static void BlendPair(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t Alpha);
+static void BlendSpan(PIXELVAL *p, COLORVAL Color, uint32_t Alpha, uint32_t Length);
+static void BlendLine(PIXELVAL *p, const void *pSrc, uint32_t Format, COLORVAL Color, uint32_t Length);
+static void EllipseArcAA(int32_t xc, int32_t yc, uint32_t A, uint32_t B, uint8_t Swap);
+#if LCD_DIRTY == 1
+static uint8_t  DirtyBounds(const uint32_t *pMap, LCD_RectTypeDef *pRect);
+static uint32_t DirtyRects(const uint32_t *pMap, LCD_RectTypeDef *pRects, uint32_t MaxRects);
+#endif
+#if LCD_OVERLAY == 1
+static void OverlayWindow(void);
+#endif
+#if LCD_OVERLAY == 1 || LCD_COLORBITDEPTH == 8
+static void WaitVBlank(void);
+#endif
+#if LCD_COLORBITDEPTH == 8
+static void PaletteUpload(uint32_t Index, uint32_t Count);
+static void PaletteReverse(uint32_t *p, uint32_t Count);
+#endif
+#if LCD_BUFFERS > 1 && LCD_BUFFER_COPY == 1
+static void CopyRect(const PIXELVAL *pSrc, uint32_t Xpos, uint32_t Ypos, uint32_t Width, uint32_t Height);
+#endif
+#if LCD_DMA2D > 0
+static void Dma2d_Wait(void);
+static void Dma2d_Fill(PIXELVAL *pDst, uint32_t DstOffset, uint32_t Width, uint32_t Height, COLORVAL Color);
+static void Dma2d_Copy(const void *pSrc, uint32_t SrcOffset, uint32_t SrcMode, PIXELVAL *pDst, uint32_t DstOffset, uint32_t Width, uint32_t Height);
+static void Dma2d_Blend(const void *pSrc, uint32_t SrcOffset, uint32_t SrcMode, COLORVAL Color, uint32_t Alpha, PIXELVAL *pDst, uint32_t DstOffset, uint32_t Width, uint32_t Height);
+#endif
 // static void SetDisplayWindow(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height);
 
 enum
@@ -126,7 +321,81 @@ const uint32_t DefaultPalette[]=
   0xFFDA00, 0xFFDA55, 0xFFDAAA, 0xFFDAFF, 0xFFFF00, 0xFFFF55, 0xFFFFAA, 0xFFFFFF};
 #endif
 
+#if   LCD_COLORBITDEPTH == 8
+/* the LTDC layer 1 CLUT (copy of the written palette) */
+static uint32_t Palette[256];
+#endif
+
 LCD_FrameBuffer fb;
+
+/* drawing target (NULL: the screen) and the screen fields of fb while an other surface is selected */
+static LCD_SurfaceTypeDef *Target = NULL;
+static LCD_SurfaceTypeDef Screen;
+
+#if LCD_BUFFERS > 1
+/* framebuffers (the displayed is Buffers[FrontBuffer], fb.pixels is the next) */
+static PIXELVAL *Buffers[LCD_BUFFERS];
+static uint8_t  BufferNum = 0;
+static uint8_t  FrontBuffer = 0;
+#if LCD_BUFFER_COPY == 1 && LCD_DIRTY == 1
+/* copy to the drawing buffer: dirty tiles of the last LCD_BUFFERS - 1 frames */
+static uint32_t DirtyPrev[LCD_DIRTY_ROWS];
+#define DIRTY_COPYRECTS       16
+#endif
+#endif
+
+#if LCD_LINEDOUBLE == 1
+/* line doubling: the displayed buffer address, the displayed source line, a swapped buffer is waiting */
+static uint32_t LineBase;
+static volatile uint32_t LineSrc;
+#if LCD_BUFFERS > 1
+static volatile uint8_t LineSwap = 0;
+#endif
+#endif
+
+#if LCD_STRIPS > 0
+/* strip scanout
+   - StripDisp: strip sequence number (counts every displayed strip) of the programmed line, DispSlot: its buffer,
+     DispStrip: its position in the frame, ScanNext: the next programmed display line
+   - StripFree: the strips before it are displayed, StripWrite: the next drawn strip sequence number
+   - StripSeq: the strip sequence number in the ring buffers
+   - StripStart: the first strip of the first drawn frame (the strips before it are the cleared startup frame) */
+#define STRIP_FRAME           (DEF_SIZEY / LCD_STRIP_LINES)
+static PIXELVAL *StripRing;
+static uint32_t ScanNext;
+static volatile uint32_t StripDisp, StripFree, DispSlot, DispStrip;
+static uint32_t StripWrite, WriteSlot;
+static volatile uint32_t StripSeq[LCD_STRIP_RING];
+static volatile uint32_t StripLateNum = 0, StripStart;
+static volatile uint8_t StripRun = 0;
+/* the drawn strip lines (the clip rectangle limit) */
+static int32_t  StripY1 = 0, StripY2 = LCD_STRIP_LINES - 1;
+#if LCD_STRIPS == 2
+#define STRIP_WAIT()          BSP_LCD_LineEvent()     /* software scanout: the beam moves one line */
+#else
+#define STRIP_WAIT()
+#endif
+#endif
+
+#if LCD_OVERLAY == 1
+/* LTDC layer 2 overlay buffer and window position (screen coordinates, it can be partly outside) */
+static struct
+{
+  uint8_t  *pixels;
+  uint16_t SizeX;
+  uint16_t SizeY;
+  int16_t  X, Y;
+  uint8_t  Bpp;
+  uint8_t  Show;
+  uint8_t  Allocated;                  /* the buffer is allocated by BSP_LCD_OverlayInit */
+}Overlay;
+
+/* overlay AL44 default palette (16 colors) */
+static const uint32_t OverlayPalette16[16] =
+{ 0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+  0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF};
+#endif
+
 /**
   * @brief  Initializes the LCD.
   * @param  None
@@ -144,23 +413,103 @@ uint8_t BSP_LCD_Init(void)
   /* LCD Init */
   #if DEF_SIZEX > 0 && DEF_SIZEY > 0 && defined(LCD_MALLOC)
   fb.SizeX = DEF_SIZEX;
-  fb.SizeY = DEF_SIZEY;
-  fb.pixels = LCD_MALLOC(DEF_SIZEX * DEF_SIZEY * LCD_BPP);
+  fb.SizeY = LCD_FB_SIZEY;
+  fb.Stride = DEF_SIZEX;
+  BSP_LCD_ResetClipRect();
+  #if LCD_STRIPS > 0
+  /* only the strip ring (fb.pixels is the drawn strip buffer shifted up by the strip position) */
+  StripRing = LCD_MALLOC(DEF_SIZEX * LCD_STRIP_LINES * LCD_STRIP_RING * LCD_BPP);
+  fb.pixels = StripRing;
+  #else
+  fb.pixels = LCD_MALLOC(DEF_SIZEX * LCD_FB_SIZEY * LCD_BPP);
+  #endif
+  #if LCD_BUFFERS > 1
+  Buffers[0] = (PIXELVAL *)fb.pixels;
+  for(BufferNum = 1; fb.pixels && BufferNum < LCD_BUFFERS; BufferNum++)
+  {
+    Buffers[BufferNum] = LCD_MALLOC(DEF_SIZEX * LCD_FB_SIZEY * LCD_BPP);
+    #ifdef LCD_MALLOC2
+    if(!Buffers[BufferNum])
+      Buffers[BufferNum] = LCD_MALLOC2(DEF_SIZEX * LCD_FB_SIZEY * LCD_BPP);
+    #endif
+    if(!Buffers[BufferNum])
+      break;
+  }
+  FrontBuffer = 0;
+  #endif
   if(fb.pixels)
   {
     //hltdc.LayerCfg[1].FBStartAdress = (uint32_t)fb.pixels;
     LTDC_Layer1->CFBAR = (uint32_t)fb.pixels;
+    LTDC_Layer1->PFCR = LCD_LTDC_PF;
+    #if LCD_LINEDOUBLE == 1 || LCD_STRIPS > 0
+    /* pitch 0: every line repeats the start address line, BSP_LCD_LineEvent steps it */
+    LTDC_Layer1->CFBLR = DEF_SIZEX * LCD_BPP + 7;
+    LTDC_Layer1->CFBLNR = DEF_SIZEY;
+    #if LCD_LINEDOUBLE == 1
+    LineBase = (uint32_t)fb.pixels;
+    LineSrc = 0;
+    /* the 2nd active line (AVBP + 2): the 2nd copy of the framebuffer line 0, the whole line time
+       is left to set the start address of the next line */
+    LTDC->LIPCR = (LTDC->BPCR & 0x7FF) + 2;
+    #else
+    /* the first frame shows the cleared ring buffers, the drawing starts with the next frame */
+    ScanNext = 1;
+    StripDisp = 0;
+    DispSlot = 0;
+    DispStrip = 0;
+    StripFree = 0;
+    for(uint32_t i = 0; i < LCD_STRIP_RING; i++)
+      StripSeq[i] = i;
+    StripWrite = STRIP_FRAME;
+    WriteSlot = STRIP_FRAME % LCD_STRIP_RING;
+    LTDC->LIPCR = (LTDC->BPCR & 0x7FF) + 1;   /* the 1st active line (it programs the 2nd) */
+    #endif
+    #if LCD_STRIPS != 2
+    LTDC->ICR = LTDC_ICR_CLIF;
+    LTDC->IER |= LTDC_IER_LIE;
+    NVIC_SetPriority(LTDC_IRQn, 0);
+    NVIC_EnableIRQ(LTDC_IRQn);
+    #endif
+    #else
+    LTDC_Layer1->CFBLR = (DEF_SIZEX * LCD_BPP) << 16 | (DEF_SIZEX * LCD_BPP + 7);
+    #endif
+    #if   LCD_DMA2D == 1 && defined(RCC_AHB3ENR_DMA2DEN)
+    RCC->AHB3ENR |= RCC_AHB3ENR_DMA2DEN;
+    #elif LCD_DMA2D == 1 && defined(RCC_AHB1ENR_DMA2DEN)
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA2DEN;
+    #endif
     #if   LCD_COLORBITDEPTH == 8
     LTDC_Layer1->CR |= LTDC_LxCR_CLUTEN;
     for(uint32_t i = 0; i < 256; i++)
+    {
+      Palette[i] = DefaultPalette[i];
       LTDC_Layer1->CLUTWR = (i << 24) | DefaultPalette[i];
+    }
     #endif
     LTDC->SRCR = LTDC_SRCR_VBR;
     ret = LCD_OK;
     /* Clear the LCD screen */
-    #if LCD_INIT_CLEAR == 1
+    #if LCD_INIT_CLEAR == 1 && LCD_BUFFERS > 1
+    for(uint32_t i = 0; i < BufferNum; i++)
+    {
+      fb.pixels = Buffers[i];
+      BSP_LCD_Clear(LCD_DEFAULT_BACKCOLOR);
+    }
+    #elif LCD_INIT_CLEAR == 1 && LCD_STRIPS > 0
+    LCD_FillSpan(StripRing, LCD_DEFAULT_BACKCOLOR, DEF_SIZEX * LCD_STRIP_LINES * LCD_STRIP_RING);
+    #elif LCD_INIT_CLEAR == 1
     BSP_LCD_Clear(LCD_DEFAULT_BACKCOLOR);
     #endif
+    #if LCD_BUFFERS > 1
+    /* draw into the next (not displayed) buffer */
+    fb.pixels = Buffers[BufferNum > 1 ? 1 : 0];
+    #if LCD_BUFFER_COPY == 1 && LCD_DIRTY == 1
+    memset(DirtyPrev, 0xFF, sizeof(DirtyPrev));
+    #endif
+    #endif
+    /* every pixel is new */
+    DIRTY_RECT(0, 0, fb.SizeX, fb.SizeY);
   }
   #endif
   
@@ -248,15 +597,127 @@ sFONT *BSP_LCD_GetFont(void)
 }
 
 /**
-  * @brief  Clears the hole LCD.
+  * @brief  Sets the text background mode.
+  * @param  Mode: LCD_TEXT_OPAQUE or LCD_TEXT_TRANSPARENT (the background pixels are not drawn)
+  * @retval None
+  */
+void BSP_LCD_SetTextMode(uint8_t Mode)
+{
+  DrawProp.TextMode = Mode;
+}
+
+/**
+  * @brief  Gets the text background mode.
+  * @param  None
+  * @retval LCD_TEXT_OPAQUE or LCD_TEXT_TRANSPARENT
+  */
+uint8_t BSP_LCD_GetTextMode(void)
+{
+  return DrawProp.TextMode;
+}
+
+/**
+  * @brief  Sets the polygon fill rule (BSP_LCD_FillPolygon).
+  * @param  Rule: LCD_FILL_NONZERO or LCD_FILL_EVENODD
+  * @retval None
+  */
+void BSP_LCD_SetFillRule(uint8_t Rule)
+{
+  DrawProp.FillRule = Rule;
+}
+
+/**
+  * @brief  Gets the polygon fill rule.
+  * @param  None
+  * @retval LCD_FILL_NONZERO or LCD_FILL_EVENODD
+  */
+uint8_t BSP_LCD_GetFillRule(void)
+{
+  return DrawProp.FillRule;
+}
+
+/**
+  * @brief  Sets the clip rectangle (the drawing functions draw only inside it).
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  Width: Rectangle width
+  * @param  Height: Rectangle height
+  * @retval None
+  */
+void BSP_LCD_SetClipRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height)
+{
+  Clip.x1 = Xpos;
+  Clip.y1 = Ypos;
+  Clip.x2 = (int32_t)Xpos + Width - 1;
+  Clip.y2 = (int32_t)Ypos + Height - 1;
+  if(Clip.x2 >= fb.SizeX)
+    Clip.x2 = fb.SizeX - 1;
+  if(Clip.y2 >= fb.SizeY)
+    Clip.y2 = fb.SizeY - 1;
+  #if LCD_STRIPS > 0
+  if(!Target)                           /* the screen: only the drawn strip lines */
+  {
+    if(Clip.y1 < StripY1)
+      Clip.y1 = StripY1;
+    if(Clip.y2 > StripY2)
+      Clip.y2 = StripY2;
+  }
+  #endif
+}
+
+/**
+  * @brief  Sets the clip rectangle to the whole LCD.
+  * @param  None
+  * @retval None
+  */
+void BSP_LCD_ResetClipRect(void)
+{
+  BSP_LCD_SetClipRect(0, 0, fb.SizeX, fb.SizeY);
+}
+
+/**
+  * @brief  Gets the clip rectangle.
+  * @param  pRect: Pointer to the rectangle
+  * @retval None
+  */
+void BSP_LCD_GetClipRect(LCD_RectTypeDef *pRect)
+{
+  pRect->X = Clip.x1;
+  pRect->Y = Clip.y1;
+  pRect->Width = Clip.x2 >= Clip.x1 ? Clip.x2 - Clip.x1 + 1 : 0;
+  pRect->Height = Clip.y2 >= Clip.y1 ? Clip.y2 - Clip.y1 + 1 : 0;
+}
+
+/**
+  * @brief  Clears the hole LCD or the selected surface (the clip rectangle is not used).
   * @param  Color: Color of the background
   * @retval None
   */
 void BSP_LCD_Clear(COLORVAL Color)
 {
-  int is = fb.SizeX * fb.SizeY;
-  for(int i = 0; i < is; i++)
-    fb.pixels[i] = Color;
+  PIXELVAL *p = (PIXELVAL *)fb.pixels;
+  uint32_t h = fb.SizeY;
+  #if LCD_STRIPS > 0
+  if(!Target)                           /* the screen: the drawn strip */
+  {
+    p += fb.Stride * StripY1;
+    h = LCD_STRIP_LINES;
+  }
+  #endif
+  DIRTY_RECT(0, 0, fb.SizeX, fb.SizeY);
+  #if LCD_DMA2D > 0
+  if(DMA2D_ADDRESSABLE(p))
+  {
+    Dma2d_Fill(p, fb.Stride - fb.SizeX, fb.SizeX, h, Color);
+    return;
+  }
+  LCD_SYNC();                           /* target in the DTCM ram: cpu fill */
+  #endif
+  if(fb.Stride == fb.SizeX)
+    LCD_FillSpan(p, Color, fb.SizeX * h);
+  else                                  /* sub-surface view: line by line */
+    for(uint32_t y = 0; y < h; y++)
+      LCD_FillSpan(&p[fb.Stride * y], Color, fb.SizeX);
 }
 
 /**
@@ -311,18 +772,19 @@ void BSP_LCD_DisplayStringAt(uint16_t Xpos, uint16_t Ypos, uint8_t *Text, Line_M
   uint16_t refcolumn = 1, i = 0;
   uint32_t size = 0, xsize = 0; 
   uint8_t  *ptr = Text;
+  uint16_t width = DrawProp.pFont->Width;
   
   /* Get the text size */
   while (*ptr++) size ++ ;
   
   /* Characters number per line */
-  xsize = (BSP_LCD_GetXSize()/DrawProp.pFont->Width);
+  xsize = (BSP_LCD_GetXSize()/width);
   
   switch (Mode)
   {
   case CENTER_MODE:
     {
-      refcolumn = Xpos + ((xsize - size)* DrawProp.pFont->Width) / 2;
+      refcolumn = Xpos + ((xsize - size)* width) / 2;
       break;
     }
   case LEFT_MODE:
@@ -332,7 +794,7 @@ void BSP_LCD_DisplayStringAt(uint16_t Xpos, uint16_t Ypos, uint8_t *Text, Line_M
     }
   case RIGHT_MODE:
     {
-      refcolumn =  - Xpos + ((xsize - size)*DrawProp.pFont->Width);
+      refcolumn =  - Xpos + ((xsize - size)*width);
       break;
     }    
   default:
@@ -342,17 +804,12 @@ void BSP_LCD_DisplayStringAt(uint16_t Xpos, uint16_t Ypos, uint8_t *Text, Line_M
     }
   }
   
-  /* Send the string character by character on lCD */
-  while ((*Text != 0) & (((BSP_LCD_GetXSize() - (i*DrawProp.pFont->Width)) & 0xFFFF) >= DrawProp.pFont->Width))
-  {
-    /* Display one character on LCD */
-    BSP_LCD_DisplayChar(refcolumn, Ypos, *Text);
-    /* Decrement the column position by 16 */
-    refcolumn += DrawProp.pFont->Width;
-    /* Point on the next character */
-    Text++;
+  /* Characters number (that fit in the screen width) */
+  while ((Text[i] != 0) & (((BSP_LCD_GetXSize() - (i*width)) & 0xFFFF) >= width))
     i++;
-  }
+
+  /* Send the string row by row on lCD */
+  DrawString((int16_t)refcolumn, (int16_t)Ypos, Text, i);
 }
 
 /**
@@ -381,7 +838,12 @@ void BSP_LCD_DisplayStringAtLine(uint16_t Line, uint8_t *ptr)
   */
 void BSP_LCD_DrawPixel(uint16_t Xpos, uint16_t Ypos, COLORVAL RGB_Code)
 {
-  fb.pixels[fb.SizeX * Ypos + Xpos] = RGB_Code;
+  int32_t x = (int16_t)Xpos, y = (int16_t)Ypos;
+  if(x < Clip.x1 || x > Clip.x2 || y < Clip.y1 || y > Clip.y2)
+    return;
+  LCD_SYNC();
+  LCD_PIXEL_WR(&fb.pixels[fb.Stride * y + x], RGB_Code);
+  DIRTY_PIXEL(x, y);
 }
   
 /**
@@ -393,12 +855,18 @@ void BSP_LCD_DrawPixel(uint16_t Xpos, uint16_t Ypos, COLORVAL RGB_Code)
   */
 void BSP_LCD_DrawHLine(uint16_t Xpos, uint16_t Ypos, uint16_t Length)
 {
-  int32_t ip = fb.SizeX * Ypos + Xpos;
-  while(Length--)
-  {
-    fb.pixels[ip] = DrawProp.TextColor;
-    ip++;
-  }
+  int32_t x1 = (int16_t)Xpos, x2 = x1 + Length - 1, y = (int16_t)Ypos;
+  if(y < Clip.y1 || y > Clip.y2)
+    return;
+  if(x1 < Clip.x1)
+    x1 = Clip.x1;
+  if(x2 > Clip.x2)
+    x2 = Clip.x2;
+  if(x1 > x2)
+    return;
+  LCD_SYNC();
+  LCD_FillSpan((PIXELVAL *)&fb.pixels[fb.Stride * y + x1], DrawProp.TextColor, x2 - x1 + 1);
+  DIRTY_RECT(x1, y, x2 - x1 + 1, 1);
 }
 
 /**
@@ -410,16 +878,30 @@ void BSP_LCD_DrawHLine(uint16_t Xpos, uint16_t Ypos, uint16_t Length)
   */
 void BSP_LCD_DrawVLine(uint16_t Xpos, uint16_t Ypos, uint16_t Length)
 {
-  int32_t ip = fb.SizeX * Ypos + Xpos;
+  int32_t ip, x = (int16_t)Xpos, y1 = (int16_t)Ypos, y2 = y1 + Length - 1;
+  if(x < Clip.x1 || x > Clip.x2)
+    return;
+  if(y1 < Clip.y1)
+    y1 = Clip.y1;
+  if(y2 > Clip.y2)
+    y2 = Clip.y2;
+  if(y1 > y2)
+    return;
+  ip = fb.Stride * y1 + x;
+  Length = y2 - y1 + 1;
+  LCD_SYNC();
+  DIRTY_RECT(x, y1, 1, Length);
   while(Length--)
   {
-    fb.pixels[ip] = DrawProp.TextColor;
-    ip+= fb.SizeX;
+    LCD_PIXEL_WR(&fb.pixels[ip], DrawProp.TextColor);
+    ip+= fb.Stride;
   }
 }
 
 /**
   * @brief  Draws an uni-line (between two points).
+  *         Run slice Bresenham: the pixels go in horizontal (or vertical) runs,
+  *         the run lengths come from one division, the runs are clipped once.
   * @param  x1: Point 1 X position
   * @param  y1: Point 1 Y position
   * @param  x2: Point 2 X position
@@ -428,68 +910,106 @@ void BSP_LCD_DrawVLine(uint16_t Xpos, uint16_t Ypos, uint16_t Length)
   */
 void BSP_LCD_DrawLine(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
 {
-  int16_t deltax = 0, deltay = 0, x = 0, y = 0, xinc1 = 0, xinc2 = 0, 
-  yinc1 = 0, yinc2 = 0, den = 0, num = 0, numadd = 0, numpixels = 0, 
-  curpixel = 0;
-  
-  deltax = ABS(x2 - x1);        /* The difference between the x's */
-  deltay = ABS(y2 - y1);        /* The difference between the y's */
-  x = x1;                       /* Start x off at the first pixel */
-  y = y1;                       /* Start y off at the first pixel */
-  
-  if (x2 >= x1)                 /* The x-values are increasing */
-  {
-    xinc1 = 1;
-    xinc2 = 1;
-  }
-  else                          /* The x-values are decreasing */
-  {
-    xinc1 = -1;
-    xinc2 = -1;
-  }
-  
-  if (y2 >= y1)                 /* The y-values are increasing */
-  {
-    yinc1 = 1;
-    yinc2 = 1;
-  }
-  else                          /* The y-values are decreasing */
-  {
-    yinc1 = -1;
-    yinc2 = -1;
-  }
-  
+  int32_t x = (int16_t)x1, y = (int16_t)y1, xe = (int16_t)x2, ye = (int16_t)y2;
+  int32_t deltax, deltay, xinc, yinc, ystep, ip, n, run, q = 0, r = 0, e = 0, lo, hi;
+  COLORVAL c = DrawProp.TextColor;
+
+  /* trivial reject: both points are on the same outer side of the clip rectangle */
+  if((x < Clip.x1 && xe < Clip.x1) || (x > Clip.x2 && xe > Clip.x2) ||
+     (y < Clip.y1 && ye < Clip.y1) || (y > Clip.y2 && ye > Clip.y2))
+    return;
+
+  deltax = ABS(xe - x);         /* The difference between the x's */
+  deltay = ABS(ye - y);         /* The difference between the y's */
+  xinc = xe >= x ? 1 : -1;
+  yinc = ye >= y ? 1 : -1;
+  ystep = yinc * fb.Stride;
+  ip = fb.Stride * y + x;
+  LCD_SYNC();
+
   if (deltax >= deltay)         /* There is at least one x-value for every y-value */
-  {
-    xinc1 = 0;                  /* Don't change the x when numerator >= denominator */
-    yinc2 = 0;                  /* Don't change the y for every iteration */
-    den = deltax;
-    num = deltax / 2;
-    numadd = deltay;
-    numpixels = deltax;         /* There are more x-values than y-values */
+  { /* horizontal runs: the first run by division, then q or q + 1 pixels (num: deltax / 2 start) */
+    n = deltax + 1;
+    run = n;
+    if(deltay)
+    {
+      run = (deltax - deltax / 2 + deltay - 1) / deltay;
+      q = deltax / deltay;
+      r = deltax % deltay;
+      e = run * deltay - (deltax - deltax / 2);
+    }
+    while(n > 0)
+    {
+      if(run > n)
+        run = n;
+      if(y >= Clip.y1 && y <= Clip.y2)
+      {
+        if(xinc > 0) { lo = x; hi = x + run - 1; }
+        else         { lo = x - run + 1; hi = x; }
+        if(lo < Clip.x1)
+          lo = Clip.x1;
+        if(hi > Clip.x2)
+          hi = Clip.x2;
+        if(lo <= hi)
+        {
+          volatile PIXELVAL *p = &fb.pixels[ip - x + lo];
+          for(int32_t i = hi - lo; i >= 0; i--)
+          {
+            LCD_PIXEL_WR(p, c);
+            p++;
+          }
+          DIRTY_HSPAN(lo, hi, y);
+        }
+      }
+      n -= run;
+      x += run * xinc;
+      ip += run * xinc + ystep;
+      y += yinc;
+      run = q + (r > e);
+      e += run * deltay - deltax;
+    }
   }
   else                          /* There is at least one y-value for every x-value */
-  {
-    xinc2 = 0;                  /* Don't change the x for every iteration */
-    yinc1 = 0;                  /* Don't change the y when numerator >= denominator */
-    den = deltay;
-    num = deltay / 2;
-    numadd = deltax;
-    numpixels = deltay;         /* There are more y-values than x-values */
-  }
-  
-  for (curpixel = 0; curpixel <= numpixels; curpixel++)
-  {
-    BSP_LCD_DrawPixel(x, y, DrawProp.TextColor);  /* Draw the current pixel */
-    num += numadd;                            /* Increase the numerator by the top of the fraction */
-    if (num >= den)                           /* Check if numerator >= denominator */
+  { /* vertical runs */
+    n = deltay + 1;
+    run = n;
+    if(deltax)
+    {
+      run = (deltay - deltay / 2 + deltax - 1) / deltax;
+      q = deltay / deltax;
+      r = deltay % deltax;
+      e = run * deltax - (deltay - deltay / 2);
+    }
+    while(n > 0)
     {
-      num -= den;                             /* Calculate the new numerator value */
-      x += xinc1;                             /* Change the x as appropriate */
-      y += yinc1;                             /* Change the y as appropriate */
+      if(run > n)
+        run = n;
+      if(x >= Clip.x1 && x <= Clip.x2)
+      {
+        if(yinc > 0) { lo = y; hi = y + run - 1; }
+        else         { lo = y - run + 1; hi = y; }
+        if(lo < Clip.y1)
+          lo = Clip.y1;
+        if(hi > Clip.y2)
+          hi = Clip.y2;
+        if(lo <= hi)
+        {
+          volatile PIXELVAL *p = &fb.pixels[ip + (lo - y) * fb.Stride];
+          for(int32_t i = hi - lo; i >= 0; i--)
+          {
+            LCD_PIXEL_WR(p, c);
+            p += fb.Stride;
+          }
+          DIRTY_VSPAN(x, lo, hi);
+        }
+      }
+      n -= run;
+      y += run * yinc;
+      ip += run * ystep + xinc;
+      x += xinc;
+      run = q + (r > e);
+      e += run * deltax - deltay;
     }
-    x += xinc2;                               /* Change the x as appropriate */
-    y += yinc2;                               /* Change the y as appropriate */
   }
 }
 
@@ -522,23 +1042,43 @@ void BSP_LCD_DrawRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Hei
 void BSP_LCD_DrawCircle(uint16_t Xpos, uint16_t Ypos, uint16_t Radius)
 {
   int32_t  D;       /* Decision Variable */ 
-  uint32_t  CurX;   /* Current X Value */
-  uint32_t  CurY;   /* Current Y Value */ 
-  
+  int32_t  CurX;    /* Current X Value */
+  int32_t  CurY;    /* Current Y Value */ 
+  int32_t  x = (int16_t)Xpos, y = (int16_t)Ypos;
+  int32_t  iym, iyp, ixm, ixp;  /* line index of y - CurY, y + CurY, y - CurX, y + CurX */
+  COLORVAL c = DrawProp.TextColor;
+  uint8_t  clip;
+
+  /* trivial reject */
+  if(x + Radius < Clip.x1 || x - Radius > Clip.x2 ||
+     y + Radius < Clip.y1 || y - Radius > Clip.y2)
+    return;
+  /* trivial accept: no clipping per pixel */
+  clip = x - Radius < Clip.x1 || x + Radius > Clip.x2 || y - Radius < Clip.y1 || y + Radius > Clip.y2;
+  if(x - Radius < INT16_MIN || x + Radius > INT16_MAX || y - Radius < INT16_MIN || y + Radius > INT16_MAX)
+  { /* the positions overflow int16_t: draw as earlier */
+    DrawCircleWrap(Xpos, Ypos, Radius);
+    return;
+  }
+
   D = 3 - (Radius << 1);
   CurX = 0;
   CurY = Radius;
+  iym = fb.Stride * (y - CurY) + x;
+  iyp = fb.Stride * (y + CurY) + x;
+  ixm = ixp = fb.Stride * y + x;
+  LCD_SYNC();
   
   while (CurX <= CurY)
   {
-    BSP_LCD_DrawPixel((Xpos + CurX), (Ypos - CurY), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos - CurX), (Ypos - CurY), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos + CurY), (Ypos - CurX), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos - CurY), (Ypos - CurX), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos + CurX), (Ypos + CurY), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos - CurX), (Ypos + CurY), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos + CurY), (Ypos + CurX), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos - CurY), (Ypos + CurX), DrawProp.TextColor);   
+    CLIP_PIXEL(iym + CurX, x + CurX, y - CurY, c, clip);
+    CLIP_PIXEL(iym - CurX, x - CurX, y - CurY, c, clip);
+    CLIP_PIXEL(ixm + CurY, x + CurY, y - CurX, c, clip);
+    CLIP_PIXEL(ixm - CurY, x - CurY, y - CurX, c, clip);
+    CLIP_PIXEL(iyp + CurX, x + CurX, y + CurY, c, clip);
+    CLIP_PIXEL(iyp - CurX, x - CurX, y + CurY, c, clip);
+    CLIP_PIXEL(ixp + CurY, x + CurY, y + CurX, c, clip);
+    CLIP_PIXEL(ixp - CurY, x - CurY, y + CurX, c, clip);
 
     if (D < 0)
     { 
@@ -546,10 +1086,14 @@ void BSP_LCD_DrawCircle(uint16_t Xpos, uint16_t Ypos, uint16_t Radius)
     }
     else
     {
-      D += ((CurX - CurY) << 2) + 10;
+      D += (CurX - CurY) * 4 + 10;
       CurY--;
+      iym += fb.Stride;
+      iyp -= fb.Stride;
     }
     CurX++;
+    ixm -= fb.Stride;
+    ixp += fb.Stride;
   } 
 }
 
@@ -590,25 +1134,59 @@ void BSP_LCD_DrawPolygon(pPoint Points, uint16_t PointCount)
 void BSP_LCD_DrawEllipse(int Xpos, int Ypos, int XRadius, int YRadius)
 {
   int x = 0, y = -YRadius, err = 2-2*XRadius, e2;
-  float K = 0, rad1 = 0, rad2 = 0;
-  
-  rad1 = XRadius;
-  rad2 = YRadius;
-  
-  K = (float)(rad2/rad1);
+  int32_t xc = (int16_t)Xpos, yc = (int16_t)Ypos, xk = 0, bx, im, ip;
+  EllipseStepTypeDef K;
+  COLORVAL c = DrawProp.TextColor;
+  uint8_t  clip, wrap;
+
+  /* trivial reject */
+  if(xc + XRadius < Clip.x1 || xc - XRadius > Clip.x2 ||
+     yc + YRadius < Clip.y1 || yc - YRadius > Clip.y2)
+    return;
+  if(!YRadius)
+  {
+    BSP_LCD_DrawHLine(xc - XRadius, yc, 2 * XRadius + 1);
+    return;
+  }
+  /* trivial accept (x / K max: x <= max(XRadius, YRadius)) */
+  bx = (uint32_t)(XRadius > YRadius ? XRadius : YRadius) * XRadius / YRadius + 1;
+  clip = xc - bx < Clip.x1 || xc + bx > Clip.x2 || yc - YRadius < Clip.y1 || yc + YRadius > Clip.y2;
+  /* very flat ellipse: the positions overflow int16_t (the pixels are drawn as earlier) */
+  wrap = xc - bx < INT16_MIN || xc + bx > INT16_MAX || yc - YRadius < INT16_MIN || yc + YRadius > INT16_MAX;
+
+  EllipseStepInit(&K, XRadius, YRadius);
+  im = fb.Stride * (yc + y) + xc;      /* line index of yc + y, yc - y */
+  ip = fb.Stride * (yc - y) + xc;
+  LCD_SYNC();
   
   do {      
-    BSP_LCD_DrawPixel((Xpos-(uint16_t)(x/K)), (Ypos+y), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos+(uint16_t)(x/K)), (Ypos+y), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos+(uint16_t)(x/K)), (Ypos-y), DrawProp.TextColor);
-    BSP_LCD_DrawPixel((Xpos-(uint16_t)(x/K)), (Ypos-y), DrawProp.TextColor);      
+    if(wrap)
+    {
+      BSP_LCD_DrawPixel((Xpos-(uint16_t)xk), (Ypos+y), c);
+      BSP_LCD_DrawPixel((Xpos+(uint16_t)xk), (Ypos+y), c);
+      BSP_LCD_DrawPixel((Xpos+(uint16_t)xk), (Ypos-y), c);
+      BSP_LCD_DrawPixel((Xpos-(uint16_t)xk), (Ypos-y), c);
+    }
+    else
+    {
+      CLIP_PIXEL(ip - xk, xc - xk, yc - y, c, clip);
+      CLIP_PIXEL(ip + xk, xc + xk, yc - y, c, clip);
+      CLIP_PIXEL(im + xk, xc + xk, yc + y, c, clip);
+      CLIP_PIXEL(im - xk, xc - xk, yc + y, c, clip);
+    }
     
     e2 = err;
     if (e2 <= x) {
       err += ++x*2+1;
+      xk = EllipseStep(&K);
       if (-y == x && e2 <= y) e2 = 0;
     }
-    if (e2 > y) err += ++y*2+1;     
+    if (e2 > y)
+    {
+      err += ++y*2+1;
+      im += fb.Stride;
+      ip -= fb.Stride;
+    }
   }
   while (y <= 0);
 }
@@ -644,17 +1222,34 @@ void BSP_LCD_DrawBitmap(uint16_t Xpos, uint16_t Ypos, uint8_t *pBmp)
   */
 void BSP_LCD_FillRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height)
 {
-  int32_t ip = fb.SizeX * Ypos + Xpos;
-  int32_t ih = fb.SizeX - Width;
+  PIXELVAL *p;
+  int32_t x1 = (int16_t)Xpos, y1 = (int16_t)Ypos, x2 = x1 + Width - 1, y2 = y1 + Height - 1;
+  if(x1 < Clip.x1)
+    x1 = Clip.x1;
+  if(y1 < Clip.y1)
+    y1 = Clip.y1;
+  if(x2 > Clip.x2)
+    x2 = Clip.x2;
+  if(y2 > Clip.y2)
+    y2 = Clip.y2;
+  if(x1 > x2 || y1 > y2)
+    return;
+  Width = x2 - x1 + 1;
+  Height = y2 - y1 + 1;
+  p = (PIXELVAL *)&fb.pixels[fb.Stride * y1 + x1];
+  DIRTY_RECT(x1, y1, Width, Height);
+  #if LCD_DMA2D > 0
+  if(Width * Height >= LCD_DMA2D_MINPIXELS && DMA2D_ADDRESSABLE(p))
+  {
+    Dma2d_Fill(p, fb.Stride - Width, Width, Height, DrawProp.TextColor);
+    return;
+  }
+  LCD_SYNC();
+  #endif
   while(Height--)
   {
-    int32_t iw = Width;
-    while(iw--)
-    {
-      fb.pixels[ip] = DrawProp.TextColor;
-      ip++;
-    }
-    ip += ih;
+    LCD_FillSpan(p, DrawProp.TextColor, Width);
+    p += fb.Stride;
   }
 }
 
@@ -668,165 +1263,2313 @@ void BSP_LCD_FillRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Hei
 void BSP_LCD_FillCircle(uint16_t Xpos, uint16_t Ypos, uint16_t Radius)
 {
   int32_t  D;        /* Decision Variable */ 
-  uint32_t  CurX;    /* Current X Value */
-  uint32_t  CurY;    /* Current Y Value */ 
+  int32_t   CurX;    /* Current X Value */
+  int32_t   CurY;    /* Current Y Value (signed: Radius = 0 steps to -1) */
   
+  /* trivial reject */
+  if((int16_t)Xpos + Radius < Clip.x1 || (int16_t)Xpos - Radius > Clip.x2 ||
+     (int16_t)Ypos + Radius < Clip.y1 || (int16_t)Ypos - Radius > Clip.y2)
+    return;
+
   D = 3 - (Radius << 1);
 
   CurX = 0;
   CurY = Radius;
-  
-  BSP_LCD_SetTextColor(DrawProp.TextColor);
 
+  /* the same pixels as the BSP_LCD_DrawCircle outline and the spans inside it,
+     every line once: the Ypos +- CurX lines at each step, the Ypos +- CurY lines
+     with the last (widest) CurX before CurY steps */
   while (CurX <= CurY)
   {
-    if(CurY > 0) 
-    {
-      BSP_LCD_DrawHLine(Xpos - CurY, Ypos + CurX, 2*CurY);
-      BSP_LCD_DrawHLine(Xpos - CurY, Ypos - CurX, 2*CurY);
-    }
-
-    if(CurX > 0) 
-    {
-      BSP_LCD_DrawHLine(Xpos - CurX, Ypos - CurY, 2*CurX);
-      BSP_LCD_DrawHLine(Xpos - CurX, Ypos + CurY, 2*CurX);
-    }
+    FillCircleLines(Xpos, Ypos, CurX, CurY);
     if (D < 0)
     { 
       D += (CurX << 2) + 6;
     }
     else
     {
-      D += ((CurX - CurY) << 2) + 10;
+      if(CurY > CurX)
+        FillCircleLines(Xpos, Ypos, CurY, CurX);
+      D += (CurX - CurY) * 4 + 10;
       CurY--;
     }
     CurX++;
   }
-
-  BSP_LCD_DrawCircle(Xpos, Ypos, Radius);
+  if(CurY >= CurX)
+    FillCircleLines(Xpos, Ypos, CurY, CurX - 1);
 }
 
 /**
-  * @brief  Draws a full poly-line (between many points).
+  * @brief  Draws a full polygon (scanline fill with the fill rule, see BSP_LCD_SetFillRule).
+  *         Every line is filled with the spans between the rounded edge crossings, each pixel once.
   * @param  Points: Pointer to the points array
   * @param  PointCount: Number of points
   * @retval None
   */
 void BSP_LCD_FillPolygon(pPoint Points, uint16_t PointCount)
 {
-  int16_t X = 0, Y = 0, X2 = 0, Y2 = 0, X_center = 0, Y_center = 0, X_first = 0, Y_first = 0, pixelX = 0, pixelY = 0, counter = 0;
-  uint16_t  IMAGE_LEFT = 0, IMAGE_RIGHT = 0, IMAGE_TOP = 0, IMAGE_BOTTOM = 0;  
-  
-  IMAGE_LEFT = IMAGE_RIGHT = Points->X;
-  IMAGE_TOP= IMAGE_BOTTOM = Points->Y;
-  
-  for(counter = 1; counter < PointCount; counter++)
+  PolyEdgeTypeDef edges[LCD_POLY_EDGES], *act[LCD_POLY_EDGES];
+  PolyEdgeTypeDef *e = edges, **a = act, t;
+  int32_t i, j, k, n = 0, na = 0, y, ylast, w, open, xs = 0, xe, sx1 = 0, sx2 = 0;
+  int32_t xmin, xmax, ymin, ymax;
+
+  if(PointCount < 2)
+    return;
+
+  xmin = xmax = POLY_X(0);
+  ymin = ymax = POLY_Y(0);
+  for(i = 1; i < PointCount; i++)
   {
-    pixelX = POLY_X(counter);
-    if(pixelX < IMAGE_LEFT)
-    {
-      IMAGE_LEFT = pixelX;
+    if(POLY_X(i) < xmin) xmin = POLY_X(i);
+    if(POLY_X(i) > xmax) xmax = POLY_X(i);
+    if(POLY_Y(i) < ymin) ymin = POLY_Y(i);
+    if(POLY_Y(i) > ymax) ymax = POLY_Y(i);
+  }
+
+  /* trivial reject */
+  if(xmax < Clip.x1 || xmin > Clip.x2 || ymax < Clip.y1 || ymin > Clip.y2)
+    return;
+  if(ymin == ymax)
+  {
+    BSP_LCD_DrawHLine(xmin, ymin, xmax - xmin + 1);
+    return;
+  }
+
+  if(PointCount > LCD_POLY_EDGES)
+  {
+    #ifdef LCD_MALLOC
+    a = LCD_MALLOC(PointCount * (sizeof(PolyEdgeTypeDef *) + sizeof(PolyEdgeTypeDef)));
+    #else
+    a = NULL;
+    #endif
+    if(!a)
+      return;
+    e = (PolyEdgeTypeDef *)(a + PointCount);
+  }
+
+  /* edge table: the not horizontal edges in first line order
+     the last line of an edge is included only at the bottom peaks (else the next edge starts there) */
+  for(i = 0; i < PointCount; i++)
+  {
+    int32_t x0 = POLY_X(i), y0 = POLY_Y(i), x1, y1;
+    j = i + 1 < PointCount ? i + 1 : 0;
+    x1 = POLY_X(j);
+    y1 = POLY_Y(j);
+    if(y0 == y1)
+      continue;
+    if(y0 < y1)
+    { /* downward: the lower point is j, the polygon goes on forward */
+      t.dir = 1;
+      for(k = j; POLY_Y(k + 1 < PointCount ? k + 1 : 0) == y1; k = k + 1 < PointCount ? k + 1 : 0);
+      k = POLY_Y(k + 1 < PointCount ? k + 1 : 0) < y1;
+    }
+    else
+    { /* upward: the lower point is i, the polygon goes on backward */
+      t.dir = -1;
+      for(k = i; POLY_Y(k ? k - 1 : PointCount - 1) == y0; k = k ? k - 1 : PointCount - 1);
+      k = POLY_Y(k ? k - 1 : PointCount - 1) < y0;
+      SWAP16(x0, x1);
+      SWAP16(y0, y1);
     }
-    if(pixelX > IMAGE_RIGHT)
+    t.y1 = y0;
+    t.y2 = y1 - 1 + k;
+    t.x = x0;
+    t.dx = x1 - x0;
+    t.ey = y1 - y0;
+    for(k = n; k > 0 && e[k - 1].y1 > t.y1; k--)
+      e[k] = e[k - 1];
+    e[k] = t;
+    n++;
+  }
+
+  y = ymin < Clip.y1 ? Clip.y1 : ymin;
+  ylast = ymax > Clip.y2 ? Clip.y2 : ymax;
+  for(i = 0; y <= ylast; y++)
+  {
+    /* active edge table: add the new edges, drop the finished ones */
+    for(; i < n && e[i].y1 <= y; i++)
     {
-      IMAGE_RIGHT = pixelX;
+      PolyEdgeTypeDef *p = &e[i];
+      int64_t num;
+      if(p->y2 < y)
+        continue;
+      /* x = floor(x0 + dx * (y - y1) / h + 0.5) = floor(num / (2 * h)), ex = the remainder */
+      num = (2 * (int64_t)p->x + 1) * p->ey + 2 * (int64_t)p->dx * (y - p->y1);
+      p->x = num / (2 * p->ey);
+      if(num < (int64_t)p->x * 2 * p->ey)
+        p->x--;
+      p->ex = num - (int64_t)p->x * 2 * p->ey;
+      k = p->dx / p->ey;
+      if(p->dx < k * p->ey)
+        k--;
+      p->edx = 2 * (p->dx - k * p->ey);
+      p->dx = k;
+      p->ey *= 2;
+      a[na++] = p;
     }
-    
-    pixelY = POLY_Y(counter);
-    if(pixelY < IMAGE_TOP)
+    for(j = k = 0; j < na; j++)
+      if(a[j]->y2 >= y)
+        a[k++] = a[j];
+    na = k;
+
+    /* x order (insertion sort: the order of the previous line is almost good) */
+    for(j = 1; j < na; j++)
     {
-      IMAGE_TOP = pixelY;
+      PolyEdgeTypeDef *p = a[j];
+      for(k = j; k > 0 && a[k - 1]->x > p->x; k--)
+        a[k] = a[k - 1];
+      a[k] = p;
     }
-    if(pixelY > IMAGE_BOTTOM)
+
+    /* spans: inside from the crossing where the winding leaves 0 until it is back to 0
+       (touching spans are merged, the pixels are drawn once) */
+    for(j = 0, w = 0, open = 0; j < na; j++)
     {
-      IMAGE_BOTTOM = pixelY;
+      if(!w)
+        xs = a[j]->x;
+      w = DrawProp.FillRule == LCD_FILL_EVENODD ? w ^ 1 : w + a[j]->dir;
+      if(!w)
+      {
+        xe = a[j]->x;
+        if(open && xs <= sx2 + 1)
+        {
+          if(xe > sx2)
+            sx2 = xe;
+        }
+        else
+        {
+          if(open)
+            BSP_LCD_DrawHLine(sx1, y, sx2 - sx1 + 1);
+          sx1 = xs;
+          sx2 = xe;
+          open = 1;
+        }
+      }
+      a[j]->x += a[j]->dx;
+      a[j]->ex += a[j]->edx;
+      if(a[j]->ex >= a[j]->ey)
+      {
+        a[j]->x++;
+        a[j]->ex -= a[j]->ey;
+      }
     }
-  }  
-  
-  if(PointCount < 2)
-  {
-    return;
+    if(open)
+      BSP_LCD_DrawHLine(sx1, y, sx2 - sx1 + 1);
   }
-  
-  X_center = (IMAGE_LEFT + IMAGE_RIGHT)/2;
-  Y_center = (IMAGE_BOTTOM + IMAGE_TOP)/2;
-  
-  X_first = Points->X;
-  Y_first = Points->Y;
-  
-  while(--PointCount)
-  {
-    X = Points->X;
+
+  #ifdef LCD_FREE
+  if(a != act)
+    LCD_FREE(a);
+  #endif
+}
+
+/**
+  * @brief  Draws a full ellipse.
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  XRadius: Ellipse X radius
+  * @param  YRadius: Ellipse Y radius  
+  * @retval None
+  */
+void BSP_LCD_FillEllipse(uint16_t Xpos, uint16_t Ypos, uint16_t XRadius, uint16_t YRadius)
+{
+  int x = 0, y = -YRadius, err = 2-2*XRadius, e2, yd;
+  uint16_t xk = 0, xd;
+  EllipseStepTypeDef K;
+
+  /* trivial reject */
+  if((int16_t)Xpos + XRadius < Clip.x1 || (int16_t)Xpos - XRadius > Clip.x2 ||
+     (int16_t)Ypos + YRadius < Clip.y1 || (int16_t)Ypos - YRadius > Clip.y2)
+    return;
+  if(!YRadius)
+  {
+    BSP_LCD_DrawHLine(Xpos - XRadius, Ypos, 2 * XRadius + 1);
+    return;
+  }
+  EllipseStepInit(&K, XRadius, YRadius);
+  
+  do 
+  { 
+    xd = xk;                            /* the line y is drawn once, when y steps (xk is the widest) */
+    yd = y;
+    e2 = err;
+    if (e2 <= x) 
+    {
+      err += ++x*2+1;
+      xk = EllipseStep(&K);
+      if (-y == x && e2 <= y) e2 = 0;
+    }
+    if (e2 > y) err += ++y*2+1;
+    if (y != yd)
+      FillCircleLines(Xpos, Ypos, -yd, xd);
+  }
+  while (y <= 0);
+}
+
+/*******************************************************************************
+                            Anti-aliased drawing
+*******************************************************************************/
+
+/**
+  * @brief  Draws an anti-aliased line (Wu, 16.16 fixed point, vertical or horizontal pixel pairs).
+  * @param  x1: Point 1 X position
+  * @param  y1: Point 1 Y position
+  * @param  x2: Point 2 X position
+  * @param  y2: Point 2 Y position
+  * @retval None
+  */
+void BSP_LCD_DrawLineAA(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+  int32_t x = (int16_t)x1, y = (int16_t)y1, xe = (int16_t)x2, ye = (int16_t)y2, t, dir;
+  uint32_t deltax, deltay, grad, frac = 0;
+
+  /* trivial reject (the pixel pairs go 1 pixel out) */
+  if((x < Clip.x1 - 1 && xe < Clip.x1 - 1) || (x > Clip.x2 + 1 && xe > Clip.x2 + 1) ||
+     (y < Clip.y1 - 1 && ye < Clip.y1 - 1) || (y > Clip.y2 + 1 && ye > Clip.y2 + 1))
+    return;
+
+  deltax = ABS(xe - x);
+  deltay = ABS(ye - y);
+  LCD_SYNC();
+  if(deltax >= deltay)
+  { /* x major: (x, y) and (x, y + dir) pairs */
+    if(x > xe)
+    {
+      t = x; x = xe; xe = t;
+      t = y; y = ye; ye = t;
+    }
+    dir = ye >= y ? 1 : -1;
+    grad = deltax ? ((deltay << 16) + deltax / 2) / deltax : 0;
+    for(; x <= xe; x++)
+    {
+      BlendPair(x, y, x, y + dir, AaCoverage[frac >> 10]);
+      frac += grad;
+      if(frac >= 0x10000)
+      {
+        frac -= 0x10000;
+        y += dir;
+      }
+    }
+  }
+  else
+  { /* y major: (x, y) and (x + dir, y) pairs */
+    if(y > ye)
+    {
+      t = x; x = xe; xe = t;
+      t = y; y = ye; ye = t;
+    }
+    dir = xe >= x ? 1 : -1;
+    grad = ((deltax << 16) + deltay / 2) / deltay;
+    for(; y <= ye; y++)
+    {
+      BlendPair(x, y, x + dir, y, AaCoverage[frac >> 10]);
+      frac += grad;
+      if(frac >= 0x10000)
+      {
+        frac -= 0x10000;
+        x += dir;
+      }
+    }
+  }
+}
+
+/**
+  * @brief  Draws an anti-aliased circle.
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  Radius: Circle radius
+  * @retval None
+  */
+void BSP_LCD_DrawCircleAA(uint16_t Xpos, uint16_t Ypos, uint16_t Radius)
+{
+  BSP_LCD_DrawEllipseAA(Xpos, Ypos, Radius, Radius);
+}
+
+/**
+  * @brief  Draws an anti-aliased ellipse (integer only, two arcs: x major and y major part).
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  XRadius: Ellipse X radius
+  * @param  YRadius: Ellipse Y radius
+  * @retval None
+  */
+void BSP_LCD_DrawEllipseAA(uint16_t Xpos, uint16_t Ypos, uint16_t XRadius, uint16_t YRadius)
+{
+  int32_t xc = (int16_t)Xpos, yc = (int16_t)Ypos;
+
+  /* trivial reject */
+  if(xc + XRadius + 1 < Clip.x1 || xc - XRadius - 1 > Clip.x2 ||
+     yc + YRadius + 1 < Clip.y1 || yc - YRadius - 1 > Clip.y2)
+    return;
+  if(!XRadius || !YRadius)
+  {
+    BSP_LCD_DrawLine(xc - XRadius, yc - YRadius, xc + XRadius, yc + YRadius);
+    return;
+  }
+  LCD_SYNC();
+  EllipseArcAA(xc, yc, XRadius, YRadius, 0);
+  EllipseArcAA(xc, yc, YRadius, XRadius, 1);
+}
+
+/**
+  * @brief  Draws an anti-aliased poly-line (between many points).
+  * @param  Points: Pointer to the points array
+  * @param  PointCount: Number of points
+  * @retval None
+  */
+void BSP_LCD_DrawPolygonAA(pPoint Points, uint16_t PointCount)
+{
+  int16_t X = 0, Y = 0;
+
+  if(PointCount < 2)
+  {
+    return;
+  }
+
+  BSP_LCD_DrawLineAA(Points->X, Points->Y, (Points+PointCount-1)->X, (Points+PointCount-1)->Y);
+  
+  while(--PointCount)
+  {
+    X = Points->X;
     Y = Points->Y;
     Points++;
-    X2 = Points->X;
-    Y2 = Points->Y;    
-    
-    BSP_LCD_FillTriangle(X, Y, X2, Y2, X_center, Y_center);
-    BSP_LCD_FillTriangle(X, Y, X_center, Y_center, X2, Y2);
-    BSP_LCD_FillTriangle(X_center, Y_center, X2, Y2, X, Y);
+    BSP_LCD_DrawLineAA(X, Y, Points->X, Points->Y);
+  }
+}
+
+/*******************************************************************************
+                            Alpha blending
+*******************************************************************************/
+
+/**
+  * @brief  Blends a color into a rectangle.
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  Width: Rectangle width
+  * @param  Height: Rectangle height
+  * @param  Color: Color
+  * @param  Alpha: Color weight (0 = transparent .. 255 = opaque)
+  * @retval None
+  */
+void BSP_LCD_BlendRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height, COLORVAL Color, uint8_t Alpha)
+{
+  PIXELVAL *p;
+  int32_t x1 = (int16_t)Xpos, y1 = (int16_t)Ypos, x2 = x1 + Width - 1, y2 = y1 + Height - 1;
+  if(x1 < Clip.x1)
+    x1 = Clip.x1;
+  if(y1 < Clip.y1)
+    y1 = Clip.y1;
+  if(x2 > Clip.x2)
+    x2 = Clip.x2;
+  if(y2 > Clip.y2)
+    y2 = Clip.y2;
+  if(x1 > x2 || y1 > y2 || !Alpha)
+    return;
+  Width = x2 - x1 + 1;
+  Height = y2 - y1 + 1;
+  p = (PIXELVAL *)&fb.pixels[fb.Stride * y1 + x1];
+  DIRTY_RECT(x1, y1, Width, Height);
+  #if LCD_DMA2D > 0
+  if(Width * Height >= LCD_DMA2D_MINPIXELS && DMA2D_ADDRESSABLE(p))
+  {
+    Dma2d_Blend(NULL, 0, DMA2D_CM_A8, Color, Alpha, p, fb.Stride - Width, Width, Height);
+    return;
+  }
+  LCD_SYNC();
+  #endif
+  while(Height--)
+  {
+    BlendSpan(p, Color, (Alpha + 4) >> 3, Width);
+    p += fb.Stride;
+  }
+}
+
+/**
+  * @brief  Draws an image with alpha channel (blended into the framebuffer).
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  Xsize: Image width
+  * @param  Ysize: Image height
+  * @param  pData: Pointer to the image (top line first)
+  * @param  Format: Source format (LCD_ARGB8888, LCD_ARGB4444, LCD_A8: the color is the text color)
+  * @retval None
+  */
+void BSP_LCD_DrawARGBImage(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16_t Ysize, const void *pData, uint32_t Format)
+{
+  PIXELVAL *p;
+  const uint8_t *ps = pData;
+  uint32_t bpp = Format == LCD_ARGB8888 ? 4 : Format == LCD_ARGB4444 ? 2 : 1;
+  int32_t x = (int16_t)Xpos, y = (int16_t)Ypos, w = Xsize, h = Ysize;
+
+  /* clip: x, y, w, h = the visible part, ps = the first visible source pixel */
+  if(x < Clip.x1)
+  {
+    ps += (Clip.x1 - x) * bpp;
+    w -= Clip.x1 - x;
+    x = Clip.x1;
+  }
+  if(x + w - 1 > Clip.x2)
+    w = Clip.x2 - x + 1;
+  if(y < Clip.y1)
+  {
+    ps += (Clip.y1 - y) * Xsize * bpp;
+    h -= Clip.y1 - y;
+    y = Clip.y1;
+  }
+  if(y + h - 1 > Clip.y2)
+    h = Clip.y2 - y + 1;
+  if(w <= 0 || h <= 0)
+    return;
+  p = (PIXELVAL *)&fb.pixels[fb.Stride * y + x];
+  DIRTY_RECT(x, y, w, h);
+
+  #if LCD_DMA2D > 0
+  if(w * h >= LCD_DMA2D_MINPIXELS && DMA2D_ADDRESSABLE(ps) && DMA2D_ADDRESSABLE(p))
+  {
+    Dma2d_Blend(ps, Xsize - w, Format, DrawProp.TextColor, 255, p, fb.Stride - w, w, h);
+    return;
+  }
+  LCD_SYNC();
+  #endif
+  while(h--)
+  {
+    BlendLine(p, ps, Format, DrawProp.TextColor, w);
+    ps += Xsize * bpp;
+    p += fb.Stride;
+  }
+}
+
+/**
+  * @brief  Enables the display.
+  * @param  None
+  * @retval None
+  */
+void BSP_LCD_DisplayOn(void)
+{
+}
+
+/**
+  * @brief  Disables the display.
+  * @param  None
+  * @retval None
+  */
+void BSP_LCD_DisplayOff(void)
+{
+}
+
+/**
+  * @brief  Shows the drawn framebuffer and selects the next one for drawing.
+  *         The LTDC takes the new buffer at the vertical blank.
+  *         - double buffer: waits for the vertical blank (the next buffer is displayed until it)
+  *         - triple buffer: waits only if the previous swap is not taken yet
+  * @param  None
+  * @retval LCD_OK: swapped, LCD_ERROR: single buffer (nothing to do)
+  */
+uint8_t BSP_LCD_SwapBuffers(void)
+{
+  #if LCD_BUFFERS > 1
+  if(BufferNum < 2)
+    return LCD_ERROR;
+
+  if(Target)                            /* the next frame is drawn into the screen */
+    BSP_LCD_SelectTarget(NULL);
+  LCD_SYNC();                           /* the DMA2D jobs into the drawn buffer */
+  #if LCD_LINEDOUBLE == 1
+  while(LineSwap);                      /* the previous swap is not taken yet */
+  FrontBuffer = (FrontBuffer + 1) % BufferNum;
+  LineSwap = 1;                         /* BSP_LCD_LineEvent takes it after the last line */
+  fb.pixels = Buffers[(FrontBuffer + 1) % BufferNum];
+  if(BufferNum == 2)
+    while(LineSwap);                    /* fb.pixels is the old displayed buffer */
+  #else
+  while(LTDC->SRCR & LTDC_SRCR_VBR);    /* the previous swap is not taken yet */
+  FrontBuffer = (FrontBuffer + 1) % BufferNum;
+  LTDC_Layer1->CFBAR = (uint32_t)Buffers[FrontBuffer];
+  LTDC->SRCR = LTDC_SRCR_VBR;
+  fb.pixels = Buffers[(FrontBuffer + 1) % BufferNum];
+  if(BufferNum == 2)
+    while(LTDC->SRCR & LTDC_SRCR_VBR);  /* fb.pixels is the old displayed buffer */
+  #endif
+
+  #if LCD_BUFFER_COPY == 1 && LCD_DIRTY == 1
+  {
+    uint32_t map[LCD_DIRTY_ROWS], i, n;
+    LCD_RectTypeDef r[DIRTY_COPYRECTS];
+    /* the drawing buffer missed the changes of the last BufferNum - 1 frames */
+    for(i = 0; i < LCD_DIRTY_ROWS; i++)
+    {
+      map[i] = fb.dirty[i];
+      if(BufferNum > 2)
+      {
+        map[i] |= DirtyPrev[i];
+        DirtyPrev[i] = fb.dirty[i];
+      }
+      fb.dirty[i] = 0;
+    }
+    n = DirtyRects(map, r, DIRTY_COPYRECTS);
+    for(i = 0; i < n; i++)
+      CopyRect(Buffers[FrontBuffer], r[i].X, r[i].Y, r[i].Width, r[i].Height);
+  }
+  #elif LCD_BUFFER_COPY == 1
+  CopyRect(Buffers[FrontBuffer], 0, 0, fb.SizeX, fb.SizeY);
+  #endif
+  return LCD_OK;
+  #else
+  return LCD_ERROR;
+  #endif
+}
+
+/**
+  * @brief  LTDC line interrupt handler (call it from the LTDC_IRQHandler, the start address is set
+  *         with immediate reload, the LTDC reads it at the next line).
+  *         - LCD_LINEDOUBLE: the interrupt comes at the second copy of every framebuffer line, the
+  *           next line start address is set, after the last line the first line of the displayed buffer
+  *           (experimental: it must be done before the LTDC fetches the next line, see LCD_LINEDOUBLE)
+  *         - LCD_STRIPS: the interrupt comes at every line, the next line start address is set from
+  *           the ring buffer of its strip (LCD_STRIPS == 2: the software scanout, one call = one line)
+  *           (experimental: it must be done before the LTDC fetches the next line, see LCD_STRIPS)
+  * @param  None
+  * @retval None
+  */
+void BSP_LCD_LineEvent(void)
+{
+  #if LCD_LINEDOUBLE == 1
+  LTDC->ICR = LTDC_ICR_CLIF;
+  if(++LineSrc >= LCD_FB_SIZEY)
+  {
+    LineSrc = 0;
+    #if LCD_BUFFERS > 1
+    if(LineSwap)
+    {
+      LineBase = (uint32_t)Buffers[FrontBuffer];
+      LineSwap = 0;
+    }
+    #endif
+  }
+  LTDC_Layer1->CFBAR = LineBase + LineSrc * (DEF_SIZEX * LCD_BPP);
+  LTDC->SRCR = LTDC_SRCR_IMR;
+  LTDC->LIPCR = (LTDC->BPCR & 0x7FF) + 2 + 2 * LineSrc;
+  #elif LCD_STRIPS > 0
+  uint32_t n = ScanNext, l = n % LCD_STRIP_LINES;
+  LTDC->ICR = LTDC_ICR_CLIF;
+  if(!l)                                /* the next strip */
+  {
+    DispSlot = DispSlot + 1 < LCD_STRIP_RING ? DispSlot + 1 : 0;
+    DispStrip = n / LCD_STRIP_LINES;
+    StripDisp++;
+    if(StripRun && StripSeq[DispSlot] != StripDisp && (int32_t)(StripDisp - StripStart) >= 0)
+      StripLateNum++;                   /* not drawn yet, an old strip is displayed */
+  }
+  else if(l == 1)
+    StripFree = StripDisp;              /* the previous strip is fully displayed */
+  LTDC_Layer1->CFBAR = (uint32_t)&StripRing[(DispSlot * LCD_STRIP_LINES + l) * DEF_SIZEX];
+  LTDC->SRCR = LTDC_SRCR_IMR;
+  ScanNext = n + 1 < DEF_SIZEY ? n + 1 : 0;
+  LTDC->LIPCR = (LTDC->BPCR & 0x7FF) + (ScanNext ? ScanNext : DEF_SIZEY);
+  #endif
+}
+
+/**
+  * @brief  Draws a frame with the strip scanout (LCD_STRIPS), strip by strip racing the beam.
+  *         Every strip is drawn into a free ring buffer (waits while it is displayed), the strips
+  *         are published after the render callback (and the DMA2D jobs) are done.
+  *         If the beam is already in the frame, the next frame is drawn, the strips that the
+  *         beam reached meanwhile are skipped (see BSP_LCD_StripLate).
+  * @param  Render: Render callback (the drawing functions draw into the strip with screen coordinates)
+  * @retval None
+  */
+void BSP_LCD_StripFrame(LCD_StripRenderTypeDef Render)
+{
+  #if LCD_STRIPS > 0
+  uint32_t s, d, ds;
+
+  if(!StripRing)
+    return;
+  if(Target)
+    BSP_LCD_SelectTarget(NULL);
+  do                                    /* consistent pair from the line interrupt */
+  {
+    d = StripDisp;
+    ds = DispStrip;
+  }while(d != StripDisp);
+  if((int32_t)(d - StripWrite) >= 0)    /* the beam is in this frame: the next one */
+  {
+    d += STRIP_FRAME - ds;
+    WriteSlot = (WriteSlot + d - StripWrite) % LCD_STRIP_RING;
+    StripWrite = d;
+  }
+  if(!StripRun)
+  {
+    StripStart = StripWrite;
+    StripRun = 1;
+  }
+
+  for(s = 0; s < STRIP_FRAME; s++)
+  {
+    while((int32_t)(StripWrite - StripFree) >= LCD_STRIP_RING) /* the ring buffer is still displayed */
+      STRIP_WAIT();
+    if((int32_t)(StripDisp - StripWrite) < 0) /* else: late, the beam is already there */
+    {
+      StripY1 = s * LCD_STRIP_LINES;
+      StripY2 = StripY1 + LCD_STRIP_LINES - 1;
+      fb.pixels = &StripRing[WriteSlot * LCD_STRIP_LINES * DEF_SIZEX] - StripY1 * DEF_SIZEX;
+      BSP_LCD_ResetClipRect();
+      Render(&StripRing[WriteSlot * LCD_STRIP_LINES * DEF_SIZEX], StripY1, LCD_STRIP_LINES);
+      if(Target)
+        BSP_LCD_SelectTarget(NULL);
+      BSP_LCD_Sync();
+      StripSeq[WriteSlot] = StripWrite;
+    }
+    StripWrite++;
+    WriteSlot = WriteSlot + 1 < LCD_STRIP_RING ? WriteSlot + 1 : 0;
+  }
+  #endif
+}
+
+/**
+  * @brief  Gets the number of the displayed but not drawn strips (since the first frame drawn by
+  *         BSP_LCD_StripFrame, the cleared startup frame is not counted).
+  * @param  None
+  * @retval Late strips
+  */
+uint32_t BSP_LCD_StripLate(void)
+{
+  #if LCD_STRIPS > 0
+  return StripLateNum;
+  #else
+  return 0;
+  #endif
+}
+
+/*******************************************************************************
+                            Palette
+*******************************************************************************/
+
+/**
+  * @brief  Sets palette entries (8 bits/pixel: the LTDC CLUT, waits for the vertical blank,
+  *         the pixels are not changed, only their color).
+  *         note: LCD_COLOR and the blending functions assume the default (RGB332) palette
+  * @param  Index: First palette entry
+  * @param  Count: Number of the entries
+  * @param  pRgb: Pointer to the colors (0xRRGGBB)
+  * @retval None
+  */
+void BSP_LCD_SetPalette(uint32_t Index, uint32_t Count, const uint32_t *pRgb)
+{
+  #if LCD_COLORBITDEPTH == 8
+  if(Index >= 256)
+    return;
+  if(Count > 256 - Index)
+    Count = 256 - Index;
+  for(uint32_t i = 0; i < Count; i++)
+    Palette[Index + i] = pRgb[i] & 0xFFFFFF;
+  PaletteUpload(Index, Count);
+  #endif
+}
+
+/**
+  * @brief  Gets palette entries (8 bits/pixel).
+  * @param  Index: First palette entry
+  * @param  Count: Number of the entries
+  * @param  pRgb: Pointer to the colors (0xRRGGBB)
+  * @retval None
+  */
+void BSP_LCD_GetPalette(uint32_t Index, uint32_t Count, uint32_t *pRgb)
+{
+  #if LCD_COLORBITDEPTH == 8
+  for(; Count && Index < 256; Count--)
+    *pRgb++ = Palette[Index++];
+  #endif
+}
+
+/**
+  * @brief  Rotates palette entries (8 bits/pixel, color cycling, waits for the vertical blank).
+  * @param  Index: First palette entry
+  * @param  Count: Number of the entries
+  * @param  Step: Rotation (positive: the colors move to the higher entries)
+  * @retval None
+  */
+void BSP_LCD_CyclePalette(uint32_t Index, uint32_t Count, int32_t Step)
+{
+  #if LCD_COLORBITDEPTH == 8
+  if(Index >= 256)
+    return;
+  if(Count > 256 - Index)
+    Count = 256 - Index;
+  if(Count < 2)
+    return;
+  Step %= (int32_t)Count;
+  if(Step < 0)
+    Step += Count;
+  if(!Step)
+    return;
+  /* rotation with three reversals (no temporary buffer) */
+  PaletteReverse(&Palette[Index], Count);
+  PaletteReverse(&Palette[Index], Step);
+  PaletteReverse(&Palette[Index + Step], Count - Step);
+  PaletteUpload(Index, Count);
+  #endif
+}
+
+/**
+  * @brief  Sets palette entries mixed from colors and a target color (8 bits/pixel, fade in / out,
+  *         waits for the vertical blank).
+  * @param  Index: First palette entry
+  * @param  Count: Number of the entries
+  * @param  pRgb: Pointer to the original colors (0xRRGGBB)
+  * @param  Rgb: Target color (0xRRGGBB)
+  * @param  Level: 0 = the original colors .. 255 = the target color
+  * @retval None
+  */
+void BSP_LCD_FadePalette(uint32_t Index, uint32_t Count, const uint32_t *pRgb, uint32_t Rgb, uint8_t Level)
+{
+  #if LCD_COLORBITDEPTH == 8
+  uint32_t c, n, s;
+  if(Index >= 256)
+    return;
+  if(Count > 256 - Index)
+    Count = 256 - Index;
+  for(uint32_t i = 0; i < Count; i++)
+  {
+    c = 0;
+    for(s = 0; s < 24; s += 8)
+    {
+      n = (pRgb[i] >> s & 0xFF) * (255 - Level) + (Rgb >> s & 0xFF) * Level;
+      c |= (n + 127) / 255 << s;
+    }
+    Palette[Index + i] = c;
+  }
+  PaletteUpload(Index, Count);
+  #endif
+}
+
+/**
+  * @brief  Converts a RGB color to the framebuffer color value
+  *         (8 bits/pixel: the nearest palette entry).
+  * @param  Rgb: Color (0xRRGGBB)
+  * @retval Color value
+  */
+COLORVAL BSP_LCD_ColorFromRgb(uint32_t Rgb)
+{
+  uint32_t r = Rgb >> 16 & 0xFF, g = Rgb >> 8 & 0xFF, b = Rgb & 0xFF;
+  #if LCD_COLORBITDEPTH == 8
+  uint32_t i, best = 0, d, bestd = 0xFFFFFFFF;
+  int32_t  dr, dg, db;
+  for(i = 0; i < 256 && bestd; i++)
+  {
+    dr = (int32_t)(Palette[i] >> 16 & 0xFF) - r;
+    dg = (int32_t)(Palette[i] >> 8 & 0xFF) - g;
+    db = (int32_t)(Palette[i] & 0xFF) - b;
+    d = 3 * dr * dr + 4 * dg * dg + 2 * db * db; /* the eye is less sensitive to the blue */
+    if(d < bestd)
+    {
+      bestd = d;
+      best = i;
+    }
+  }
+  return best;
+  #else
+  return LCD_COLOR(r, g, b);
+  #endif
+}
+
+/**
+  * @brief  Converts a framebuffer color value to RGB color (8 bits/pixel: the palette color).
+  * @param  Color: Color value
+  * @retval Color (0xRRGGBB)
+  */
+uint32_t BSP_LCD_ColorToRgb(COLORVAL Color)
+{
+  #if   LCD_COLORBITDEPTH == 8
+  return Palette[Color];
+  #elif LCD_COLORBITDEPTH == 16
+  return (Color & 0xF800) << 8 | (Color & 0xE000) << 3 | (Color & 0x07E0) << 5 | (Color & 0x0600) >> 1 |
+         (Color & 0x001F) << 3 | (Color & 0x001C) >> 2;
+  #else
+  return Color & 0xFFFFFF;
+  #endif
+}
+
+/*******************************************************************************
+                            Surfaces
+*******************************************************************************/
+
+/**
+  * @brief  Initializes a surface on a pixel buffer (the pixel format is the framebuffer format).
+  *         note: the buffer have the same rules as the framebuffer (DMA2D reach, D-cache)
+  * @param  pSurface: Pointer to the surface
+  * @param  pPixels: Pointer to the pixel buffer
+  * @param  Width: Surface width
+  * @param  Height: Surface height
+  * @param  Stride: Pixels / line in the buffer (0: Width)
+  * @retval LCD state
+  */
+uint8_t BSP_LCD_InitSurface(LCD_SurfaceTypeDef *pSurface, void *pPixels, uint16_t Width, uint16_t Height, uint16_t Stride)
+{
+  if(!Stride)
+    Stride = Width;
+  if(!pPixels || !Width || !Height || Stride < Width)
+    return LCD_ERROR;
+  pSurface->pixels = pPixels;
+  pSurface->SizeX = Width;
+  pSurface->SizeY = Height;
+  pSurface->Stride = Stride;
+  pSurface->Format = LCD_COLORBITDEPTH;
+  return LCD_OK;
+}
+
+/**
+  * @brief  Creates a surface (the descriptor and the pixels are in one LCD_MALLOC block).
+  * @param  Width: Surface width
+  * @param  Height: Surface height
+  * @retval Pointer to the surface (NULL: not enough memory)
+  */
+LCD_SurfaceTypeDef *BSP_LCD_CreateSurface(uint16_t Width, uint16_t Height)
+{
+  LCD_SurfaceTypeDef *pSurface = NULL;
+  #ifdef LCD_MALLOC
+  if(Width && Height)
+    pSurface = LCD_MALLOC(sizeof(LCD_SurfaceTypeDef) + (uint32_t)Width * Height * LCD_BPP);
+  if(pSurface)
+    BSP_LCD_InitSurface(pSurface, pSurface + 1, Width, Height, Width);
+  #endif
+  return pSurface;
+}
+
+/**
+  * @brief  Deletes a surface created by BSP_LCD_CreateSurface (its views are invalid after it).
+  * @param  pSurface: Pointer to the surface
+  * @retval None
+  */
+void BSP_LCD_DeleteSurface(LCD_SurfaceTypeDef *pSurface)
+{
+  if(!pSurface)
+    return;
+  if(Target && Target->pixels >= pSurface->pixels &&
+     Target->pixels < pSurface->pixels + pSurface->Stride * pSurface->SizeY)
+    BSP_LCD_SelectTarget(NULL);
+  LCD_SYNC();                           /* a DMA2D job may still use it */
+  #ifdef LCD_FREE
+  LCD_FREE(pSurface);
+  #endif
+}
+
+/**
+  * @brief  Makes a view into a rectangle of a surface (no copy, the view draws into the parent pixels).
+  *         note: the screen views point into the current drawing buffer (SwapBuffers changes it)
+  * @param  pView: Pointer to the view
+  * @param  pParent: Pointer to the parent surface (NULL: the screen)
+  * @param  Xpos: X position in the parent
+  * @param  Ypos: Y position in the parent
+  * @param  Width: View width (clamped to the parent)
+  * @param  Height: View height (clamped to the parent)
+  * @retval LCD state
+  */
+uint8_t BSP_LCD_SubSurface(LCD_SurfaceTypeDef *pView, const LCD_SurfaceTypeDef *pParent, uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height)
+{
+  LCD_SurfaceTypeDef p;
+  if(pParent)
+    p = *pParent;
+  else if(Target)
+    p = Screen;
+  else if(BSP_LCD_InitSurface(&p, (PIXELVAL *)fb.pixels, fb.SizeX, fb.SizeY, fb.Stride) != LCD_OK)
+    return LCD_ERROR;                   /* no framebuffer (before BSP_LCD_Init) */
+  if(Xpos >= p.SizeX || Ypos >= p.SizeY || !Width || !Height)
+    return LCD_ERROR;
+  if(Width > p.SizeX - Xpos)
+    Width = p.SizeX - Xpos;
+  if(Height > p.SizeY - Ypos)
+    Height = p.SizeY - Ypos;
+  return BSP_LCD_InitSurface(pView, &p.pixels[p.Stride * Ypos + Xpos], Width, Height, p.Stride);
+}
+
+/**
+  * @brief  Selects the drawing target of every drawing function (the clip rectangle is reset to it).
+  *         The dirty region is screen only: a screen view is marked changed when an other target is selected.
+  * @param  pSurface: Pointer to the surface or view (NULL: the screen)
+  * @retval LCD state
+  */
+uint8_t BSP_LCD_SelectTarget(LCD_SurfaceTypeDef *pSurface)
+{
+  if(pSurface && (!pSurface->pixels || pSurface->Format != LCD_COLORBITDEPTH))
+    return LCD_ERROR;
+
+  if(Target)
+  { /* back to the screen */
+    fb.pixels = Screen.pixels;
+    fb.SizeX = Screen.SizeX;
+    fb.SizeY = Screen.SizeY;
+    fb.Stride = Screen.Stride;
+    #if LCD_DIRTY == 1
+    DirtyOn = 1;
+    if(Target->pixels >= Screen.pixels && Target->pixels < Screen.pixels + Screen.Stride * Screen.SizeY)
+    {
+      uint32_t i = Target->pixels - Screen.pixels;
+      BSP_LCD_SetDirty(i % Screen.Stride, i / Screen.Stride, Target->SizeX, Target->SizeY);
+    }
+    #endif
+    Target = NULL;
+  }
+
+  if(pSurface)
+  {
+    BSP_LCD_InitSurface(&Screen, (PIXELVAL *)fb.pixels, fb.SizeX, fb.SizeY, fb.Stride);
+    fb.pixels = pSurface->pixels;
+    fb.SizeX = pSurface->SizeX;
+    fb.SizeY = pSurface->SizeY;
+    fb.Stride = pSurface->Stride;
+    #if LCD_DIRTY == 1
+    DirtyOn = 0;
+    #endif
+    Target = pSurface;
+  }
+  BSP_LCD_ResetClipRect();
+  return LCD_OK;
+}
+
+/**
+  * @brief  Gets the drawing target.
+  * @param  None
+  * @retval Pointer to the selected surface (NULL: the screen)
+  */
+LCD_SurfaceTypeDef *BSP_LCD_GetTarget(void)
+{
+  return Target;
+}
+
+/**
+  * @brief  Draws a surface into the drawing target (one DMA2D job or cpu line copies).
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  pSurface: Pointer to the surface (not the drawing target)
+  * @retval None
+  */
+void BSP_LCD_DrawSurface(uint16_t Xpos, uint16_t Ypos, const LCD_SurfaceTypeDef *pSurface)
+{
+  PIXELVAL *p;
+  const PIXELVAL *ps = pSurface->pixels;
+  int32_t x = (int16_t)Xpos, y = (int16_t)Ypos, w = pSurface->SizeX, h = pSurface->SizeY;
+
+  if(pSurface == Target)
+    return;
+  /* clip: x, y, w, h = the visible part, ps = the first visible source pixel */
+  if(x < Clip.x1)
+  {
+    ps += Clip.x1 - x;
+    w -= Clip.x1 - x;
+    x = Clip.x1;
+  }
+  if(x + w - 1 > Clip.x2)
+    w = Clip.x2 - x + 1;
+  if(y < Clip.y1)
+  {
+    ps += (Clip.y1 - y) * pSurface->Stride;
+    h -= Clip.y1 - y;
+    y = Clip.y1;
+  }
+  if(y + h - 1 > Clip.y2)
+    h = Clip.y2 - y + 1;
+  if(w <= 0 || h <= 0)
+    return;
+  DIRTY_RECT(x, y, w, h);
+
+  p = (PIXELVAL *)&fb.pixels[fb.Stride * y + x];
+  #if LCD_DMA2D > 0
+  if(w * h >= LCD_DMA2D_MINPIXELS && DMA2D_ADDRESSABLE(ps) && DMA2D_ADDRESSABLE(p))
+  {
+    Dma2d_Copy(ps, pSurface->Stride - w, DMA2D_CM_OUTPUT, p, fb.Stride - w, w, h);
+    return;
+  }
+  #endif
+  LCD_SYNC();
+  while(h--)
+  {
+    memcpy(p, ps, w * sizeof(PIXELVAL));
+    p += fb.Stride;
+    ps += pSurface->Stride;
+  }
+}
+
+/*******************************************************************************
+                            LTDC layer 2 overlay
+*******************************************************************************/
+
+/**
+  * @brief  Initializes the overlay (LTDC layer 2 above the framebuffer, hidden until BSP_LCD_OverlayShow).
+  *         The buffer is cleared (ARGB4444, AL44: transparent, L8: palette index 0), the palette is
+  *         the default (L8: RGB332, AL44: 16 colors), the constant alpha is 255, no color key.
+  * @param  pPixels: Pointer to the overlay buffer (Width * Height pixels, NULL: allocated with LCD_MALLOC)
+  * @param  Width: Overlay width
+  * @param  Height: Overlay height
+  * @param  Format: Pixel format (LCD_OVERLAY_ARGB4444, LCD_OVERLAY_L8, LCD_OVERLAY_AL44)
+  * @retval LCD state
+  */
+uint8_t BSP_LCD_OverlayInit(void *pPixels, uint16_t Width, uint16_t Height, uint8_t Format)
+{
+  #if LCD_OVERLAY == 1
+  uint32_t i, bpp = Format == LCD_OVERLAY_ARGB4444 ? 2 : 1;
+
+  if(!Width || !Height || Width > DEF_SIZEX || Height > DEF_SIZEY ||
+     (Format != LCD_OVERLAY_ARGB4444 && Format != LCD_OVERLAY_L8 && Format != LCD_OVERLAY_AL44))
+    return LCD_ERROR;
+
+  if(LTDC_Layer2->CR & LTDC_LxCR_LEN)
+  {
+    LTDC_Layer2->CR = 0;
+    LTDC->SRCR = LTDC_SRCR_VBR;
+    while(LTDC->SRCR & LTDC_SRCR_VBR);  /* the LTDC does not read the old overlay buffer */
+  }
+  #ifdef LCD_MALLOC
+  if(Overlay.Allocated)
+    LCD_FREE(Overlay.pixels);
+  #endif
+  Overlay.pixels = NULL;
+  Overlay.Allocated = 0;
+  Overlay.Show = 0;
+  #ifdef LCD_MALLOC
+  if(!pPixels)
+  {
+    pPixels = LCD_MALLOC(Width * Height * bpp);
+    Overlay.Allocated = pPixels != NULL;
+  }
+  #endif
+  if(!pPixels)
+    return LCD_ERROR;
+
+  Overlay.pixels = pPixels;
+  Overlay.SizeX = Width;
+  Overlay.SizeY = Height;
+  Overlay.X = 0;
+  Overlay.Y = 0;
+  Overlay.Bpp = bpp;
+  memset(pPixels, 0, Width * Height * bpp);
+
+  LTDC_Layer2->PFCR = Format;
+  LTDC_Layer2->CACR = 255;
+  LTDC_Layer2->DCCR = 0;
+  LTDC_Layer2->BFCR = 6 << 8 | 7;       /* pixel alpha x constant alpha */
+  LTDC_Layer2->CR = 0;
+  if(Format != LCD_OVERLAY_ARGB4444)
+  {
+    for(i = 0; i < 256; i++)            /* the layer is disabled, the CLUT is writable */
+      LTDC_Layer2->CLUTWR = i << 24 | (Format == LCD_OVERLAY_AL44 ? OverlayPalette16[i & 15] :
+                            ((i >> 5) * 255 / 7) << 16 | ((i >> 2 & 7) * 255 / 7) << 8 | (i & 3) * 0x55);
+    LTDC_Layer2->CR = LTDC_LxCR_CLUTEN;
+  }
+  OverlayWindow();
+  return LCD_OK;
+  #else
+  return LCD_ERROR;
+  #endif
+}
+
+/**
+  * @brief  Shows or hides the overlay (from the next frame).
+  * @param  Show: 0 = hide, 1 = show
+  * @retval None
+  */
+void BSP_LCD_OverlayShow(uint8_t Show)
+{
+  #if LCD_OVERLAY == 1
+  Overlay.Show = Show != 0;
+  if(Overlay.pixels)
+    OverlayWindow();
+  #endif
+}
+
+/**
+  * @brief  Moves the overlay (from the next frame, only the layer window registers are changed).
+  * @param  Xpos: X position on the screen (it can be negative, the overlay can be partly outside)
+  * @param  Ypos: Y position on the screen
+  * @retval None
+  */
+void BSP_LCD_OverlayMove(int16_t Xpos, int16_t Ypos)
+{
+  #if LCD_OVERLAY == 1
+  Overlay.X = Xpos;
+  Overlay.Y = Ypos;
+  if(Overlay.pixels)
+    OverlayWindow();
+  #endif
+}
+
+/**
+  * @brief  Sets the overlay constant alpha (multiplied with the pixel alpha).
+  * @param  Alpha: 0 = transparent .. 255 = opaque
+  * @retval None
+  */
+void BSP_LCD_OverlaySetAlpha(uint8_t Alpha)
+{
+  #if LCD_OVERLAY == 1
+  LTDC_Layer2->CACR = Alpha;
+  LTDC->SRCR = LTDC_SRCR_VBR;
+  #endif
+}
+
+/**
+  * @brief  Sets the overlay color key (the pixels with this color are transparent).
+  * @param  Rgb: Key color (0xRRGGBB, the palette color at L8 and AL44)
+  * @retval None
+  */
+void BSP_LCD_OverlaySetColorKey(uint32_t Rgb)
+{
+  #if LCD_OVERLAY == 1
+  LTDC_Layer2->CKCR = Rgb & 0xFFFFFF;
+  LTDC_Layer2->CR |= LTDC_LxCR_COLKEN;
+  LTDC->SRCR = LTDC_SRCR_VBR;
+  #endif
+}
+
+/**
+  * @brief  Disables the overlay color key.
+  * @param  None
+  * @retval None
+  */
+void BSP_LCD_OverlayResetColorKey(void)
+{
+  #if LCD_OVERLAY == 1
+  LTDC_Layer2->CR &= ~LTDC_LxCR_COLKEN;
+  LTDC->SRCR = LTDC_SRCR_VBR;
+  #endif
+}
+
+/**
+  * @brief  Sets overlay palette entries (L8: 256 entries, AL44: 16 entries).
+  *         If the overlay is shown, waits for the vertical blank (the CLUT is writable only then).
+  * @param  Index: First palette entry
+  * @param  Count: Number of the entries
+  * @param  pRgb: Pointer to the colors (0xRRGGBB)
+  * @retval None
+  */
+void BSP_LCD_OverlaySetPalette(uint32_t Index, uint32_t Count, const uint32_t *pRgb)
+{
+  #if LCD_OVERLAY == 1
+  if(LTDC_Layer2->CR & LTDC_LxCR_LEN)
+    WaitVBlank();
+  for(; Count && Index < 256; Count--)
+    LTDC_Layer2->CLUTWR = Index++ << 24 | (*pRgb++ & 0xFFFFFF);
+  #endif
+}
+
+/**
+  * @brief  Fills a rectangle in the overlay buffer.
+  * @param  Xpos: X position in the overlay
+  * @param  Ypos: Y position in the overlay
+  * @param  Width: Rectangle width
+  * @param  Height: Rectangle height
+  * @param  Color: Overlay pixel value (ARGB4444, L8: palette index, AL44: alpha << 4 | palette index)
+  * @retval None
+  */
+void BSP_LCD_OverlayFillRect(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height, uint32_t Color)
+{
+  #if LCD_OVERLAY == 1
+  uint8_t *p;
+
+  if(!Overlay.pixels || Xpos >= Overlay.SizeX || Ypos >= Overlay.SizeY)
+    return;
+  if(Width > Overlay.SizeX - Xpos)
+    Width = Overlay.SizeX - Xpos;
+  if(Height > Overlay.SizeY - Ypos)
+    Height = Overlay.SizeY - Ypos;
+  p = &Overlay.pixels[(Overlay.SizeX * Ypos + Xpos) * Overlay.Bpp];
+  while(Height--)
+  {
+    if(Overlay.Bpp == 2)
+      LCD_FillSpan16((uint16_t *)p, Color, Width);
+    else
+      LCD_FillSpan8(p, Color, Width);
+    p += Overlay.SizeX * Overlay.Bpp;
+  }
+  #endif
+}
+
+/**
+  * @brief  Displays characters in the overlay buffer with the current font (the text mode is used,
+  *         the characters are drawn while they fit into the overlay).
+  * @param  Xpos: X position in the overlay
+  * @param  Ypos: Y position in the overlay
+  * @param  Text: Pointer to string to display
+  * @param  TextColor: Overlay pixel value of the character pixels
+  * @param  BackColor: Overlay pixel value of the background pixels
+  * @retval None
+  */
+void BSP_LCD_OverlayDisplayStringAt(uint16_t Xpos, uint16_t Ypos, uint8_t *Text, uint32_t TextColor, uint32_t BackColor)
+{
+  #if LCD_OVERLAY == 1
+  sFONT    *pFont = DrawProp.pFont;
+  uint32_t width = pFont->Width, bytes = (pFont->Width + 7) / 8;
+  uint32_t size = pFont->Height * bytes;
+  uint32_t x, y, line, c;
+  const uint8_t *pchar;
+  uint8_t  *p;
+
+  if(!Overlay.pixels)
+    return;
+  for(; *Text && Xpos + width <= Overlay.SizeX; Text++, Xpos += width)
+  {
+    pchar = &pFont->table[(*Text - ' ') * size];
+    for(y = 0; y < pFont->Height && Ypos + y < Overlay.SizeY; y++, pchar += bytes)
+    {
+      line = bytes == 1 ? pchar[0] : bytes == 2 ? (pchar[0] << 8 | pchar[1]) :
+                                     (pchar[0] << 16 | pchar[1] << 8 | pchar[2]);
+      line <<= 32 - 8 * bytes;          /* the first column to the MSB */
+      p = &Overlay.pixels[(Overlay.SizeX * (Ypos + y) + Xpos) * Overlay.Bpp];
+      for(x = 0; x < width; x++, line <<= 1, p += Overlay.Bpp)
+      {
+        if(line & 0x80000000)
+          c = TextColor;
+        else if(DrawProp.TextMode == LCD_TEXT_OPAQUE)
+          c = BackColor;
+        else
+          continue;
+        if(Overlay.Bpp == 2)
+          *(uint16_t *)p = c;
+        else
+          *p = c;
+      }
+    }
+  }
+  #endif
+}
+
+/*******************************************************************************
+                            Dirty region
+*******************************************************************************/
+
+/**
+  * @brief  Marks a rectangle as changed (for the direct fb.pixels writes).
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  Width: Rectangle width
+  * @param  Height: Rectangle height
+  * @retval None
+  */
+void BSP_LCD_SetDirty(uint16_t Xpos, uint16_t Ypos, uint16_t Width, uint16_t Height)
+{
+  #if LCD_DIRTY == 1
+  uint32_t x2, y2, mask;
+  if(Xpos >= DEF_SIZEX || Ypos >= LCD_FB_SIZEY || !Width || !Height)
+    return;
+  x2 = Xpos + Width - 1;
+  y2 = Ypos + Height - 1;
+  if(x2 >= DEF_SIZEX)
+    x2 = DEF_SIZEX - 1;
+  if(y2 >= LCD_FB_SIZEY)
+    y2 = LCD_FB_SIZEY - 1;
+  mask = (2u << (x2 >> LCD_DIRTY_TILEX)) - (1u << (Xpos >> LCD_DIRTY_TILEX));
+  for(uint32_t y = Ypos >> LCD_DIRTY_TILEY; y <= y2 >> LCD_DIRTY_TILEY; y++)
+    fb.dirty[y] |= mask;
+  #endif
+}
+
+/**
+  * @brief  Clears the dirty region.
+  * @param  None
+  * @retval None
+  */
+void BSP_LCD_ClearDirty(void)
+{
+  #if LCD_DIRTY == 1
+  memset(fb.dirty, 0, sizeof(fb.dirty));
+  #endif
+}
+
+/**
+  * @brief  Gets the bounding rectangle of the dirty region.
+  * @param  pRect: Pointer to the rectangle
+  * @retval 1: there is dirty region, 0: nothing changed
+  */
+uint8_t BSP_LCD_GetDirtyRect(LCD_RectTypeDef *pRect)
+{
+  #if LCD_DIRTY == 1
+  return DirtyBounds(fb.dirty, pRect);
+  #else
+  pRect->X = 0;
+  pRect->Y = 0;
+  pRect->Width = DEF_SIZEX;
+  pRect->Height = LCD_FB_SIZEY;
+  return 1;
+  #endif
+}
+
+/**
+  * @brief  Gets the dirty region as tile aligned rectangles (the neighbour tiles are merged).
+  *         If the rectangles do not fit into pRects, the bounding rectangle is given.
+  * @param  pRects: Pointer to the rectangles array
+  * @param  MaxRects: Size of the rectangles array
+  * @retval Number of the rectangles
+  */
+uint32_t BSP_LCD_GetDirtyRects(LCD_RectTypeDef *pRects, uint32_t MaxRects)
+{
+  if(!MaxRects)
+    return 0;
+  #if LCD_DIRTY == 1
+  return DirtyRects(fb.dirty, pRects, MaxRects);
+  #else
+  return BSP_LCD_GetDirtyRect(pRects);
+  #endif
+}
+
+/*******************************************************************************
+                            DMA2D jobs fence
+*******************************************************************************/
+
+/**
+  * @brief  Gets the fence of the last started DMA2D job.
+  * @param  None
+  * @retval Fence value (for BSP_LCD_FenceDone, BSP_LCD_WaitFence)
+  */
+uint32_t BSP_LCD_Fence(void)
+{
+  return Dma2dSeq;
+}
+
+/**
+  * @brief  Checks the DMA2D job (and every previous job) is done.
+  * @param  Fence: Fence value from BSP_LCD_Fence
+  * @retval 1: done, 0: still running
+  */
+uint8_t BSP_LCD_FenceDone(uint32_t Fence)
+{
+  #if LCD_DMA2D == 1
+  /* only the last started job can be running (the next start waits for it) */
+  if(Fence == Dma2dSeq && Dma2dBusy)
+  {
+    if(DMA2D->CR & DMA2D_CR_START)
+      return 0;
+    Dma2dBusy = 0;
+  }
+  #endif
+  return 1;
+}
+
+/**
+  * @brief  Waits for the DMA2D job (and every previous job).
+  * @param  Fence: Fence value from BSP_LCD_Fence
+  * @retval None
+  */
+void BSP_LCD_WaitFence(uint32_t Fence)
+{
+  while(!BSP_LCD_FenceDone(Fence));
+}
+
+/**
+  * @brief  Waits for every DMA2D job.
+  * @param  None
+  * @retval None
+  */
+void BSP_LCD_Sync(void)
+{
+  LCD_SYNC();
+}
+
+/*******************************************************************************
+                            Span fill kernels
+*******************************************************************************/
+
+/**
+  * @brief  Fills 32 bit words (the body of every span fill).
+  * @param  p: Pointer to the first word (32 bit aligned)
+  * @param  w: Word value (the replicated color)
+  * @param  n: Number of words
+  * @retval None
+  */
+static void FillWords(uint32a_t *p, uint32_t w, uint32_t n)
+{
+  #if defined(__ARM_ARCH_7EM__)
+  /* Cortex-M4/M7: 64 bits aligned STRD stores, one cache line / loop */
+  uint64a_t *p64;
+  uint64_t w64;
+  if(((uintptr_t)p & 4) && n)
+  {
+    *p++ = w;
+    n--;
+  }
+  p64 = (uint64a_t *)p;
+  w64 = (uint64_t)w << 32 | w;
+  for(uint32_t i = n >> 3; i; i--)
+  {
+    p64[0] = w64;
+    p64[1] = w64;
+    p64[2] = w64;
+    p64[3] = w64;
+    p64 += 4;
+  }
+  p = (uint32a_t *)p64;
+  n &= 7;
+  #else
+  /* portable C path (4 words / loop) */
+  for(uint32_t i = n >> 2; i; i--)
+  {
+    p[0] = w;
+    p[1] = w;
+    p[2] = w;
+    p[3] = w;
+    p += 4;
+  }
+  n &= 3;
+  #endif
+  while(n--)
+    *p++ = w;
+}
+
+/**
+  * @brief  Fills a 8 bits/pixel span.
+  * @param  p: Pointer to the first pixel
+  * @param  Color: Fill color
+  * @param  Length: Number of pixels
+  * @retval None
+  */
+void LCD_FillSpan8(uint8_t *p, uint8_t Color, uint32_t Length)
+{
+  if(Length >= 8)
+  {
+    while((uintptr_t)p & 3)           /* head: align to 32 bits */
+    {
+      *p++ = Color;
+      Length--;
+    }
+    FillWords((uint32a_t *)p, Color * 0x01010101u, Length >> 2);
+    p += Length & ~3;
+    Length &= 3;
+  }
+  while(Length--)                     /* tail */
+    *p++ = Color;
+}
+
+/**
+  * @brief  Fills a 16 bits/pixel span.
+  * @param  p: Pointer to the first pixel (16 bit aligned)
+  * @param  Color: Fill color
+  * @param  Length: Number of pixels
+  * @retval None
+  */
+void LCD_FillSpan16(uint16_t *p, uint16_t Color, uint32_t Length)
+{
+  if(Length >= 4)
+  {
+    if((uintptr_t)p & 2)              /* head: align to 32 bits */
+    {
+      *p++ = Color;
+      Length--;
+    }
+    FillWords((uint32a_t *)p, Color * 0x00010001u, Length >> 1);
+    p += Length & ~1;
+    Length &= 1;
+  }
+  while(Length--)                     /* tail */
+    *p++ = Color;
+}
+
+/**
+  * @brief  Fills a packed 24 bits/pixel span (4 pixels in 3 words).
+  * @param  p: Pointer to the first pixel
+  * @param  Color: Fill color (0x00RRGGBB)
+  * @param  Length: Number of pixels
+  * @retval None
+  */
+void LCD_FillSpan24(uint8_t *p, uint32_t Color, uint32_t Length)
+{
+  uint8_t  b = Color, g = Color >> 8, r = Color >> 16;
+  if(Length >= 8)
+  {
+    uint32_t w0, w1, w2, i;
+    uint32a_t *pw;
+    while((uintptr_t)p & 3)           /* head: 0..3 pixels to align to 32 bits */
+    {
+      p[0] = b; p[1] = g; p[2] = r;
+      p += 3;
+      Length--;
+    }
+    Color &= 0x00FFFFFF;              /* little endian: B G R B, G R B G, R B G R */
+    w0 = Color | Color << 24;
+    w1 = Color >> 8 | Color << 16;
+    w2 = Color >> 16 | Color << 8;
+    pw = (uint32a_t *)p;
+    for(i = Length >> 2; i; i--)
+    {
+      pw[0] = w0;
+      pw[1] = w1;
+      pw[2] = w2;
+      pw += 3;
+    }
+    p = (uint8_t *)pw;
+    Length &= 3;
+  }
+  while(Length--)                     /* tail */
+  {
+    p[0] = b; p[1] = g; p[2] = r;
+    p += 3;
+  }
+}
+
+/**
+  * @brief  Fills a 32 bits/pixel span.
+  * @param  p: Pointer to the first pixel (32 bit aligned)
+  * @param  Color: Fill color
+  * @param  Length: Number of pixels
+  * @retval None
+  */
+void LCD_FillSpan32(uint32_t *p, uint32_t Color, uint32_t Length)
+{
+  FillWords((uint32a_t *)p, Color, Length);
+}
+
+/**
+  * @brief  Blends two RGB565 pixel pairs (two pixels in one 32 bit word).
+  *         The fields are split into two words with 5 free bits above every field:
+  *         0x07E0F81F: G1, R0, B0, (w >> 5) & 0x07C0F83F: R1, B1, G0
+  * @param  Fg: Foreground pixels
+  * @param  Bg: Background pixels
+  * @param  Alpha: Foreground weight (0..32)
+  * @retval Blended pixels
+  */
+uint32_t LCD_Blend565x2(uint32_t Fg, uint32_t Bg, uint32_t Alpha)
+{
+  uint32_t na = 32 - Alpha;
+  uint32_t a = ((Fg & 0x07E0F81F) * Alpha + (Bg & 0x07E0F81F) * na) >> 5;
+  uint32_t b = (((Fg >> 5) & 0x07C0F83F) * Alpha + ((Bg >> 5) & 0x07C0F83F) * na) >> 5;
+  return (a & 0x07E0F81F) | (b & 0x07C0F83F) << 5;
+}
+
+/*******************************************************************************
+                            Static Functions
+*******************************************************************************/
+
+#if LCD_DIRTY == 1
+/**
+  * @brief  Gets the bounding rectangle of a dirty tiles map.
+  * @param  pMap: Pointer to the tiles map
+  * @param  pRect: Pointer to the rectangle
+  * @retval 1: there is dirty tile, 0: nothing changed
+  */
+static uint8_t DirtyBounds(const uint32_t *pMap, LCD_RectTypeDef *pRect)
+{
+  uint32_t rows = (LCD_FB_SIZEY + (1 << LCD_DIRTY_TILEY) - 1) >> LCD_DIRTY_TILEY;
+  uint32_t m = 0, y1 = rows, y2 = 0, x1 = 0, x2 = 31, e;
+  for(uint32_t y = 0; y < rows; y++)
+  {
+    if(pMap[y])
+    {
+      m |= pMap[y];
+      if(y1 == rows)
+        y1 = y;
+      y2 = y;
+    }
+  }
+  if(!m)
+    return 0;
+  while(!(m & (1u << x1)))
+    x1++;
+  while(!(m & (1u << x2)))
+    x2--;
+  pRect->X = x1 << LCD_DIRTY_TILEX;
+  pRect->Y = y1 << LCD_DIRTY_TILEY;
+  e = (x2 + 1) << LCD_DIRTY_TILEX;
+  pRect->Width = (e < DEF_SIZEX ? e : DEF_SIZEX) - pRect->X;
+  e = (y2 + 1) << LCD_DIRTY_TILEY;
+  pRect->Height = (e < LCD_FB_SIZEY ? e : LCD_FB_SIZEY) - pRect->Y;
+  return 1;
+}
+
+/**
+  * @brief  Converts a dirty tiles map to rectangles.
+  *         The tile runs of a tile row are one rectangle, it grows down
+  *         if the next tile row have the same run.
+  * @param  pMap: Pointer to the tiles map
+  * @param  pRects: Pointer to the rectangles array
+  * @param  MaxRects: Size of the rectangles array (min 1)
+  * @retval Number of the rectangles
+  */
+static uint32_t DirtyRects(const uint32_t *pMap, LCD_RectTypeDef *pRects, uint32_t MaxRects)
+{
+  uint32_t rows = (LCD_FB_SIZEY + (1 << LCD_DIRTY_TILEY) - 1) >> LCD_DIRTY_TILEY;
+  uint32_t cols = (DEF_SIZEX + (1 << LCD_DIRTY_TILEX) - 1) >> LCD_DIRTY_TILEX;
+  uint32_t n = 0, tx, x, y, w, h, i;
+  for(uint32_t ty = 0; ty < rows; ty++)
+  {
+    uint32_t m = pMap[ty];
+    y = ty << LCD_DIRTY_TILEY;
+    h = LCD_FB_SIZEY - y < (1 << LCD_DIRTY_TILEY) ? LCD_FB_SIZEY - y : (1 << LCD_DIRTY_TILEY);
+    for(tx = 0; m && tx < cols; tx++)
+    {
+      if(!(m & (1u << tx)))
+        continue;
+      x = tx << LCD_DIRTY_TILEX;
+      while(tx < cols && (m & (1u << tx)))
+        m &= ~(1u << tx++);
+      w = (tx << LCD_DIRTY_TILEX < DEF_SIZEX ? tx << LCD_DIRTY_TILEX : DEF_SIZEX) - x;
+      for(i = 0; i < n; i++)          /* same run in the previous tile row ? */
+      {
+        if(pRects[i].X == x && pRects[i].Width == w && pRects[i].Y + pRects[i].Height == y)
+        {
+          pRects[i].Height += h;
+          break;
+        }
+      }
+      if(i < n)
+        continue;
+      if(n == MaxRects)               /* too many rectangles */
+        return DirtyBounds(pMap, pRects);
+      pRects[n].X = x;
+      pRects[n].Y = y;
+      pRects[n].Width = w;
+      pRects[n].Height = h;
+      n++;
+    }
+  }
+  return n;
+}
+#endif
+
+#if LCD_OVERLAY == 1
+/**
+  * @brief  Sets the overlay layer window, the start address and the line length from the overlay
+  *         position (the invisible part is cut, the LTDC takes the registers at the vertical blank).
+  * @param  None
+  * @retval None
+  */
+static void OverlayWindow(void)
+{
+  uint32_t ahbp = LTDC->BPCR >> 16 & 0xFFF, avbp = LTDC->BPCR & 0x7FF;
+  int32_t  sx = (LTDC->AWCR >> 16 & 0xFFF) - ahbp, sy = (LTDC->AWCR & 0x7FF) - avbp; /* active size */
+  int32_t  x1 = Overlay.X, y1 = Overlay.Y;
+  int32_t  x2 = x1 + Overlay.SizeX - 1, y2 = y1 + Overlay.SizeY - 1;
+  uint32_t pitch = Overlay.SizeX * Overlay.Bpp;
+  uint8_t  *p = Overlay.pixels;
+
+  if(x1 < 0)
+  {
+    p -= x1 * Overlay.Bpp;
+    x1 = 0;
+  }
+  if(y1 < 0)
+  {
+    p -= y1 * pitch;
+    y1 = 0;
+  }
+  if(x2 >= sx)
+    x2 = sx - 1;
+  if(y2 >= sy)
+    y2 = sy - 1;
+
+  if(!Overlay.Show || x1 > x2 || y1 > y2)
+    LTDC_Layer2->CR &= ~LTDC_LxCR_LEN;  /* nothing is visible */
+  else
+  {
+    LTDC_Layer2->WHPCR = (ahbp + 1 + x2) << 16 | (ahbp + 1 + x1);
+    LTDC_Layer2->WVPCR = (avbp + 1 + y2) << 16 | (avbp + 1 + y1);
+    LTDC_Layer2->CFBAR = (uint32_t)p;
+    LTDC_Layer2->CFBLR = pitch << 16 | ((x2 - x1 + 1) * Overlay.Bpp + 7);
+    LTDC_Layer2->CFBLNR = y2 - y1 + 1;
+    LTDC_Layer2->CR |= LTDC_LxCR_LEN;
+  }
+  LTDC->SRCR = LTDC_SRCR_VBR;
+}
+#endif
+
+#if LCD_OVERLAY == 1 || LCD_COLORBITDEPTH == 8
+/**
+  * @brief  Waits for the start of the vertical blank (the CLUT is writable in the blanking period).
+  * @param  None
+  * @retval None
+  */
+static void WaitVBlank(void)
+{
+  while(!(LTDC->CDSR & LTDC_CDSR_VDES));  /* the whole blanking period */
+  while(LTDC->CDSR & LTDC_CDSR_VDES);
+}
+#endif
+
+#if LCD_COLORBITDEPTH == 8
+/**
+  * @brief  Writes palette entries into the LTDC layer 1 CLUT at the vertical blank.
+  * @param  Index: First palette entry
+  * @param  Count: Number of the entries
+  * @retval None
+  */
+static void PaletteUpload(uint32_t Index, uint32_t Count)
+{
+  WaitVBlank();
+  for(; Count; Count--, Index++)
+    LTDC_Layer1->CLUTWR = Index << 24 | Palette[Index];
+}
+
+/**
+  * @brief  Reverses the order of palette entries.
+  * @param  p: Pointer to the first entry
+  * @param  Count: Number of the entries
+  * @retval None
+  */
+static void PaletteReverse(uint32_t *p, uint32_t Count)
+{
+  uint32_t t, *q = p + Count - 1;
+  for(; p < q; p++, q--)
+  {
+    t = *p;
+    *p = *q;
+    *q = t;
+  }
+}
+#endif
+
+#if LCD_BUFFERS > 1 && LCD_BUFFER_COPY == 1
+/**
+  * @brief  Copies a rectangle from an other framebuffer into the drawing buffer.
+  * @param  pSrc: Pointer to the source framebuffer
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  Width: Rectangle width
+  * @param  Height: Rectangle height
+  * @retval None
+  */
+static void CopyRect(const PIXELVAL *pSrc, uint32_t Xpos, uint32_t Ypos, uint32_t Width, uint32_t Height)
+{
+  uint32_t ip = fb.Stride * Ypos + Xpos;
+  #if LCD_DMA2D > 0
+  if(Width * Height >= LCD_DMA2D_MINPIXELS && DMA2D_ADDRESSABLE(pSrc) && DMA2D_ADDRESSABLE(fb.pixels))
+  {
+    Dma2d_Copy(&pSrc[ip], fb.Stride - Width, DMA2D_CM_OUTPUT, (PIXELVAL *)&fb.pixels[ip], fb.Stride - Width, Width, Height);
+    return;
+  }
+  #endif
+  LCD_SYNC();
+  while(Height--)
+  {
+    memcpy((PIXELVAL *)&fb.pixels[ip], &pSrc[ip], Width * sizeof(PIXELVAL));
+    ip += fb.Stride;
+  }
+}
+#endif
+
+#if LCD_DMA2D > 0
+/**
+  * @brief  Waits for the running DMA2D job.
+  * @param  None
+  * @retval None
+  */
+static void Dma2d_Wait(void)
+{
+  #if LCD_DMA2D == 1
+  while(DMA2D->CR & DMA2D_CR_START);
+  #endif
+  Dma2dBusy = 0;
+}
+
+/**
+  * @brief  Starts a DMA2D register to memory job (rectangle fill).
+  * @param  pDst: Pointer to the first pixel
+  * @param  DstOffset: Pixels skipped at the end of the lines
+  * @param  Width: Rectangle width
+  * @param  Height: Rectangle height
+  * @param  Color: Fill color
+  * @retval None
+  */
+static void Dma2d_Fill(PIXELVAL *pDst, uint32_t DstOffset, uint32_t Width, uint32_t Height, COLORVAL Color)
+{
+  LCD_SYNC();
+  #if LCD_DMA2D == 1
+  DMA2D->CR = DMA2D_MODE_R2M;
+  DMA2D->OPFCCR = DMA2D_CM_OUTPUT;
+  DMA2D->OCOLR = Color;
+  DMA2D->OMAR = (uint32_t)pDst;
+  DMA2D->OOR = DstOffset;
+  DMA2D->NLR = Width << DMA2D_NLR_PL_Pos | Height;
+  DMA2D->CR |= DMA2D_CR_START;
+  Dma2dBusy = 1;
+  #else
+  while(Height--)
+  {
+    LCD_FillSpan(pDst, Color, Width);
+    pDst += Width + DstOffset;
+  }
+  #endif
+  Dma2dSeq++;
+}
+
+/**
+  * @brief  Starts a DMA2D memory to memory job with pixel format conversion.
+  * @param  pSrc: Pointer to the first source pixel
+  * @param  SrcOffset: Source pixels skipped at the end of the lines
+  * @param  SrcMode: Source color mode (DMA2D_CM_...)
+  * @param  pDst: Pointer to the first destination pixel
+  * @param  DstOffset: Destination pixels skipped at the end of the lines
+  * @param  Width: Image width
+  * @param  Height: Image height
+  * @retval None
+  */
+static void Dma2d_Copy(const void *pSrc, uint32_t SrcOffset, uint32_t SrcMode, PIXELVAL *pDst, uint32_t DstOffset, uint32_t Width, uint32_t Height)
+{
+  LCD_SYNC();
+  #if LCD_DMA2D == 1
+  DMA2D->CR = DMA2D_MODE_M2M_PFC;
+  DMA2D->FGMAR = (uint32_t)pSrc;
+  DMA2D->FGOR = SrcOffset;
+  DMA2D->FGPFCCR = SrcMode;
+  DMA2D->OPFCCR = DMA2D_CM_OUTPUT;
+  DMA2D->OMAR = (uint32_t)pDst;
+  DMA2D->OOR = DstOffset;
+  DMA2D->NLR = Width << DMA2D_NLR_PL_Pos | Height;
+  DMA2D->CR |= DMA2D_CR_START;
+  Dma2dBusy = 1;
+  #else
+  const uint16_t *ps = pSrc;          /* emulation: RGB565, RGB888 or output format source */
+  const uint8_t  *pb = pSrc;
+  if(SrcMode == DMA2D_CM_OUTPUT)
+  {
+    const PIXELVAL *pc = pSrc;
+    while(Height--)
+    {
+      memcpy(pDst, pc, Width * sizeof(PIXELVAL));
+      pc += Width + SrcOffset;
+      pDst += Width + DstOffset;
+    }
+  }
+  else if(SrcMode == DMA2D_CM_RGB888) while(Height--)
+  {
+    for(uint32_t i = Width; i; i--)
+    {
+      LCD_PIXEL_WR(pDst, LCD_COLOR(pb[2], pb[1], pb[0]));
+      pDst++;
+      pb += 3;
+    }
+    pb += SrcOffset * 3;
+    pDst += DstOffset;
+  }
+  else while(Height--)
+  {
+    for(uint32_t i = Width; i; i--)
+    {
+      LCD_PIXEL_WR(pDst, LCD_COLOR_FROM_RGB565(*ps));
+      pDst++;
+      ps++;
+    }
+    ps += SrcOffset;
+    pDst += DstOffset;
+  }
+  #endif
+  Dma2dSeq++;
+}
+
+/**
+  * @brief  Starts a DMA2D memory to memory job with blending (the background is the destination).
+  * @param  pSrc: Pointer to the first source pixel (NULL: constant color and alpha)
+  * @param  SrcOffset: Source pixels skipped at the end of the lines
+  * @param  SrcMode: Source color mode (DMA2D_CM_ARGB8888, DMA2D_CM_ARGB4444, DMA2D_CM_A8)
+  * @param  Color: Source color (DMA2D_CM_A8)
+  * @param  Alpha: Constant alpha (if pSrc == NULL)
+  * @param  pDst: Pointer to the first destination pixel
+  * @param  DstOffset: Destination pixels skipped at the end of the lines
+  * @param  Width: Image width
+  * @param  Height: Image height
+  * @retval None
+  */
+static void Dma2d_Blend(const void *pSrc, uint32_t SrcOffset, uint32_t SrcMode, COLORVAL Color, uint32_t Alpha, PIXELVAL *pDst, uint32_t DstOffset, uint32_t Width, uint32_t Height)
+{
+  LCD_SYNC();
+  #if LCD_DMA2D == 1
+  DMA2D->CR = DMA2D_MODE_M2M_BLEND;
+  if(pSrc)
+  {
+    DMA2D->FGMAR = (uint32_t)pSrc;
+    DMA2D->FGOR = SrcOffset;
+    DMA2D->FGPFCCR = SrcMode;
+  }
+  else
+  { /* A8 foreground with replaced alpha: the read data is not used (the destination is read) */
+    DMA2D->FGMAR = (uint32_t)pDst;
+    DMA2D->FGOR = DstOffset;
+    DMA2D->FGPFCCR = DMA2D_CM_A8 | DMA2D_AM_REPLACE | Alpha << DMA2D_FGPFCCR_ALPHA_Pos;
+  }
+  DMA2D->FGCOLR = DMA2D_COLOR(Color);
+  DMA2D->BGMAR = (uint32_t)pDst;
+  DMA2D->BGOR = DstOffset;
+  DMA2D->BGPFCCR = DMA2D_CM_OUTPUT;
+  DMA2D->OPFCCR = DMA2D_CM_OUTPUT;
+  DMA2D->OMAR = (uint32_t)pDst;
+  DMA2D->OOR = DstOffset;
+  DMA2D->NLR = Width << DMA2D_NLR_PL_Pos | Height;
+  DMA2D->CR |= DMA2D_CR_START;
+  Dma2dBusy = 1;
+  #else
+  const uint8_t *ps = pSrc;           /* emulation: the cpu blend */
+  uint32_t bpp = SrcMode == DMA2D_CM_ARGB8888 ? 4 : SrcMode == DMA2D_CM_ARGB4444 ? 2 : 1;
+  while(Height--)
+  {
+    if(ps)
+    {
+      BlendLine(pDst, ps, SrcMode, Color, Width);
+      ps += (Width + SrcOffset) * bpp;
+    }
+    else
+      BlendSpan(pDst, Color, (Alpha + 4) >> 3, Width);
+    pDst += Width + DstOffset;
   }
-  
-  BSP_LCD_FillTriangle(X_first, Y_first, X2, Y2, X_center, Y_center);
-  BSP_LCD_FillTriangle(X_first, Y_first, X_center, Y_center, X2, Y2);
-  BSP_LCD_FillTriangle(X_center, Y_center, X2, Y2, X_first, Y_first);
+  #endif
+  Dma2dSeq++;
 }
+#endif
 
 /**
-  * @brief  Draws a full ellipse.
+  * @brief  Draws a circle with BSP_LCD_DrawPixel (for the int16_t overflowing positions).
   * @param  Xpos: X position
   * @param  Ypos: Y position
-  * @param  XRadius: Ellipse X radius
-  * @param  YRadius: Ellipse Y radius  
+  * @param  Radius: Circle radius
   * @retval None
   */
-void BSP_LCD_FillEllipse(uint16_t Xpos, uint16_t Ypos, uint16_t XRadius, uint16_t YRadius)
+static void DrawCircleWrap(uint16_t Xpos, uint16_t Ypos, uint16_t Radius)
 {
-  int x = 0, y = -YRadius, err = 2-2*XRadius, e2;
-  float K = 0, rad1 = 0, rad2 = 0;
-  
-  rad1 = XRadius;
-  rad2 = YRadius;
-  
-  K = (float)(rad2/rad1);    
-  
-  do 
-  { 
-    BSP_LCD_DrawHLine((Xpos-(uint16_t)(x/K)), (Ypos+y), (2*(uint16_t)(x/K) + 1));
-    BSP_LCD_DrawHLine((Xpos-(uint16_t)(x/K)), (Ypos-y), (2*(uint16_t)(x/K) + 1));
-    
-    e2 = err;
-    if (e2 <= x) 
+  int32_t  D = 3 - (Radius << 1);
+  uint32_t CurX = 0, CurY = Radius;
+  while (CurX <= CurY)
+  {
+    BSP_LCD_DrawPixel((Xpos + CurX), (Ypos - CurY), DrawProp.TextColor);
+    BSP_LCD_DrawPixel((Xpos - CurX), (Ypos - CurY), DrawProp.TextColor);
+    BSP_LCD_DrawPixel((Xpos + CurY), (Ypos - CurX), DrawProp.TextColor);
+    BSP_LCD_DrawPixel((Xpos - CurY), (Ypos - CurX), DrawProp.TextColor);
+    BSP_LCD_DrawPixel((Xpos + CurX), (Ypos + CurY), DrawProp.TextColor);
+    BSP_LCD_DrawPixel((Xpos - CurX), (Ypos + CurY), DrawProp.TextColor);
+    BSP_LCD_DrawPixel((Xpos + CurY), (Ypos + CurX), DrawProp.TextColor);
+    BSP_LCD_DrawPixel((Xpos - CurY), (Ypos + CurX), DrawProp.TextColor);
+    if (D < 0)
+      D += (CurX << 2) + 6;
+    else
     {
-      err += ++x*2+1;
-      if (-y == x && e2 <= y) e2 = 0;
+      D += ((CurX - CurY) << 2) + 10;
+      CurY--;
     }
-    if (e2 > y) err += ++y*2+1;
+    CurX++;
   }
-  while (y <= 0);
 }
 
 /**
-  * @brief  Enables the display.
-  * @param  None
+  * @brief  Ellipse x scale stepper init.
+  *         The result is bit exact with the float (x / K) of the original ellipse algorithm:
+  *         K = YRadius / XRadius rounded to float (m * 2^-s), x / K = x * 2^s / m rounded to float.
+  * @param  e: Pointer to the stepper
+  * @param  XRadius: Ellipse X radius
+  * @param  YRadius: Ellipse Y radius (not 0)
   * @retval None
   */
-void BSP_LCD_DisplayOn(void)
+static void EllipseStepInit(EllipseStepTypeDef *e, uint32_t XRadius, uint32_t YRadius)
+{
+  uint64_t q, r;
+  int32_t  s = 0;
+  e->f = 0;
+  e->rem = 0;
+  e->p = 1;
+  if(!XRadius)
+  { /* K = infinite, x / K = 0 */
+    e->a = 0;
+    e->b = 0;
+    e->m = 1;
+    return;
+  }
+  while(((uint64_t)YRadius << s) / XRadius < (1u << 23))
+    s++;
+  q = ((uint64_t)YRadius << s) / XRadius;
+  r = ((uint64_t)YRadius << s) % XRadius;
+  if(2 * r > XRadius || (2 * r == XRadius && (q & 1)))
+    q++;                              /* round to nearest even */
+  if(q == (1u << 24))
+  {
+    q >>= 1;
+    s--;
+  }
+  e->m = q;
+  e->a = (1ull << s) / q;
+  e->b = (1ull << s) % q;
+}
+
+/**
+  * @brief  Ellipse x scale stepper (x + 1).
+  * @param  e: Pointer to the stepper
+  * @retval (uint16_t)(x / K)
+  */
+static uint32_t EllipseStep(EllipseStepTypeDef *e)
 {
+  e->f += e->a;
+  e->rem += e->b;
+  if(e->rem >= e->m)
+  {
+    e->rem -= e->m;
+    e->f++;
+  }
+  if(!e->f)
+    return 0;
+  while(e->p * 2 <= e->f)
+    e->p *= 2;
+  /* the float rounds up to the next integer if the distance is <= 1/2 ulp (ulp = p * 2^-23) */
+  if(((uint64_t)(e->m - e->rem) << 24) <= (uint64_t)e->m * e->p)
+    return e->f + 1;
+  return e->f;
 }
 
 /**
-  * @brief  Disables the display.
-  * @param  None
+  * @brief  Draws the Ypos - Dy and Ypos + Dy lines from Xpos - Dx to Xpos + Dx (once if Dy = 0).
+  * @param  Xpos: Center X position
+  * @param  Ypos: Center Y position
+  * @param  Dy: Line distance from the center
+  * @param  Dx: Half line length
   * @retval None
   */
-void BSP_LCD_DisplayOff(void)
+static void FillCircleLines(uint16_t Xpos, uint16_t Ypos, uint32_t Dy, uint32_t Dx)
 {
+  BSP_LCD_DrawHLine(Xpos - Dx, Ypos - Dy, 2 * Dx + 1);
+  if(Dy)
+    BSP_LCD_DrawHLine(Xpos - Dx, Ypos + Dy, 2 * Dx + 1);
 }
 
-/*******************************************************************************
-                            Static Functions
-*******************************************************************************/
+/**
+  * @brief  Triangle edge x stepper init (the only divisions of the edge).
+  * @param  e: Pointer to the stepper
+  * @param  x0: X of the upper point
+  * @param  dx: X difference of the lower and the upper point
+  * @param  dy: Y difference of the lower and the upper point (> 0)
+  * @param  n: First line (from the upper point)
+  * @retval None
+  */
+static inline void TriEdgeInit(TriEdgeTypeDef *e, int32_t x0, int32_t dx, int32_t dy, uint32_t n)
+{
+  uint32_t adx = ABS(dx), q = adx / dy;
+  e->dir = dx < 0 ? -1 : 1;
+  e->dy = dy;
+  e->q = e->dir * (int32_t)q;
+  e->r = adx - q * dy;
+  e->x = x0;
+  e->rem = 0;
+  if(n)                                 /* the first lines are clipped */
+  {
+    q = adx * n / dy;
+    e->x += e->dir * (int32_t)q;
+    e->rem = adx * n - q * dy;
+  }
+}
+
+/**
+  * @brief  Triangle edge x stepper (next line).
+  * @param  e: Pointer to the stepper
+  * @retval None
+  */
+static inline void TriEdgeStep(TriEdgeTypeDef *e)
+{
+  int32_t m;
+  e->rem += e->r - e->dy;
+  m = e->rem >> 31;                     /* no carry: -1 (branch free, the carry is random) */
+  e->x += e->q + (e->dir & ~m);
+  e->rem += e->dy & m;
+}
+
+/**
+  * @brief  Blends two colors.
+  * @param  Fg: Foreground color
+  * @param  Bg: Background color
+  * @param  Alpha: Foreground weight (0..32)
+  * @retval Blended color
+  */
+static COLORVAL BlendColor(COLORVAL Fg, COLORVAL Bg, uint32_t Alpha)
+{
+  #if   LCD_COLORBITDEPTH == 8
+  uint32_t na = 32 - Alpha;
+  /* RGB332 -> R: 16..18, G: 8..10, B: 0..1 (5 bits free above every field) */
+  uint32_t f = (Fg & 0xE0) << 11 | (Fg & 0x1C) << 6 | (Fg & 0x03);
+  uint32_t b = (Bg & 0xE0) << 11 | (Bg & 0x1C) << 6 | (Bg & 0x03);
+  f = ((f * Alpha + b * na) >> 5) & 0x070703;
+  return (f >> 11) | (f >> 6) | (f & 0x03);
+  #elif LCD_COLORBITDEPTH == 16
+  /* RGB565 -> G: 21..26, R: 11..15, B: 0..4 (one multiply / color) */
+  uint32_t na = 32 - Alpha;
+  uint32_t f = (Fg | (uint32_t)Fg << 16) & 0x07E0F81F;
+  uint32_t b = (Bg | (uint32_t)Bg << 16) & 0x07E0F81F;
+  f = ((f * Alpha + b * na) >> 5) & 0x07E0F81F;
+  return f | f >> 16;
+  #else
+  uint32_t na = 32 - Alpha;
+  /* R and B in one step, G in an other */
+  return ((((Fg & 0xFF00FF) * Alpha + (Bg & 0xFF00FF) * na) >> 5) & 0xFF00FF) |
+         ((((Fg & 0x00FF00) * Alpha + (Bg & 0x00FF00) * na) >> 5) & 0x00FF00) | (Bg & 0xFF000000);
+  #endif
+}
+
+/**
+  * @brief  Blends the text color into an anti-aliased pixel pair.
+  *         16 bits/pixel: both pixels in one word (bg0, c) * Alpha + (c, bg1) * (32 - Alpha)
+  * @param  x0, y0: Pixel 0 position (text color weight: 32 - Alpha)
+  * @param  x1, y1: Pixel 1 position (text color weight: Alpha)
+  * @param  Alpha: 0..32
+  * @retval None
+  */
+static void BlendPair(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t Alpha)
+{
+  COLORVAL c = DrawProp.TextColor;
+  volatile PIXELVAL *p0 = NULL, *p1 = NULL;
+  if(Alpha < 32 && x0 >= Clip.x1 && x0 <= Clip.x2 && y0 >= Clip.y1 && y0 <= Clip.y2)
+  {
+    p0 = &fb.pixels[fb.Stride * y0 + x0];
+    DIRTY_PIXEL(x0, y0);
+  }
+  if(Alpha && x1 >= Clip.x1 && x1 <= Clip.x2 && y1 >= Clip.y1 && y1 <= Clip.y2)
+  {
+    p1 = &fb.pixels[fb.Stride * y1 + x1];
+    DIRTY_PIXEL(x1, y1);
+  }
+  #if LCD_COLORBITDEPTH == 16
+  if(p0 && p1)
+  {
+    uint32_t w = LCD_Blend565x2(*p0 | (uint32_t)c << 16, c | (uint32_t)*p1 << 16, Alpha);
+    *p0 = w;
+    *p1 = w >> 16;
+    return;
+  }
+  #endif
+  if(p0)
+    LCD_PIXEL_WR(p0, BlendColor(c, LCD_PIXEL_RD(p0), 32 - Alpha));
+  if(p1)
+    LCD_PIXEL_WR(p1, BlendColor(c, LCD_PIXEL_RD(p1), Alpha));
+}
+
+/**
+  * @brief  Blends a color into a span.
+  *         16 bits/pixel: two pixels in one word, the color * Alpha part is calculated only once
+  * @param  p: Pointer to the first pixel
+  * @param  Color: Color
+  * @param  Alpha: Color weight (0..32)
+  * @param  Length: Number of pixels
+  * @retval None
+  */
+static void BlendSpan(PIXELVAL *p, COLORVAL Color, uint32_t Alpha, uint32_t Length)
+{
+  if(Alpha >= 32)
+  {
+    LCD_FillSpan(p, Color, Length);
+    return;
+  }
+  #if LCD_COLORBITDEPTH == 16
+  if(Length >= 4)
+  {
+    uint32_t na = 32 - Alpha, w;
+    uint32_t ca = (Color * 0x00010001u & 0x07E0F81F) * Alpha;
+    uint32_t cb = ((Color * 0x00010001u >> 5) & 0x07C0F83F) * Alpha;
+    if((uintptr_t)p & 2)              /* head: align to 32 bits */
+    {
+      LCD_PIXEL_WR(p, BlendColor(Color, LCD_PIXEL_RD(p), Alpha));
+      p++;
+      Length--;
+    }
+    for(uint32_t n = Length >> 1; n; n--)
+    {
+      w = *(uint32a_t *)p;
+      *(uint32a_t *)p = (((ca + (w & 0x07E0F81F) * na) >> 5) & 0x07E0F81F) |
+                        (((cb + ((w >> 5) & 0x07C0F83F) * na) >> 5) & 0x07C0F83F) << 5;
+      p += 2;
+    }
+    Length &= 1;
+  }
+  #endif
+  while(Length--)                     /* tail */
+  {
+    LCD_PIXEL_WR(p, BlendColor(Color, LCD_PIXEL_RD(p), Alpha));
+    p++;
+  }
+}
+
+/**
+  * @brief  Blends an image line with alpha channel into a span.
+  * @param  p: Pointer to the first pixel
+  * @param  pSrc: Pointer to the first source pixel
+  * @param  Format: Source format (LCD_ARGB8888, LCD_ARGB4444, LCD_A8)
+  * @param  Color: Color (LCD_A8)
+  * @param  Length: Number of pixels
+  * @retval None
+  */
+static void BlendLine(PIXELVAL *p, const void *pSrc, uint32_t Format, COLORVAL Color, uint32_t Length)
+{
+  uint32_t s, a;
+  COLORVAL c = Color;
+  for(uint32_t i = 0; i < Length; i++)
+  {
+    if(Format == LCD_ARGB8888)
+    {
+      s = ((const uint32_t *)pSrc)[i];
+      a = s >> 24;
+      c = LCD_COLOR(((s >> 16) & 0xFF), ((s >> 8) & 0xFF), (s & 0xFF));
+    }
+    else if(Format == LCD_ARGB4444)
+    {
+      s = ((const uint16_t *)pSrc)[i];
+      a = (s >> 12) * 17;
+      c = LCD_COLOR(((s >> 8) & 0xF) * 17, ((s >> 4) & 0xF) * 17, (s & 0xF) * 17);
+    }
+    else
+      a = ((const uint8_t *)pSrc)[i];
+    a = (a + 4) >> 3;                 /* 0..32 */
+    if(a >= 32)
+      LCD_PIXEL_WR(&p[i], c);
+    else if(a)
+      LCD_PIXEL_WR(&p[i], BlendColor(c, LCD_PIXEL_RD(&p[i]), a));
+  }
+}
+
+/**
+  * @brief  Draws the anti-aliased part of an ellipse where u is the major direction
+  *         (4 mirrored arcs, v = B * sqrt(1 - u^2 / A^2), (v, v + 1) pixel pairs).
+  *         v^2 steps without division: 256 B^2 (A^2 - u^2) / A^2 as quotient and remainder.
+  * @param  xc, yc: Center
+  * @param  A: u radius
+  * @param  B: v radius
+  * @param  Swap: 0: u = x, v = y (the u = v point is drawn), 1: u = y, v = x
+  * @retval None
+  */
+static void EllipseArcAA(int32_t xc, int32_t yc, uint32_t A, uint32_t B, uint8_t Swap)
+{
+  uint64_t a2 = (uint64_t)A * A, b2 = (uint64_t)B * B;
+  uint64_t tq = b2 << 8, tr = 0;      /* v^2 (8 fraction bits) = tq + tr / a2 */
+  uint64_t dq, dr, eq, er;            /* v^2 decrement (256 b2 (2u + 1) / a2) and its increment (512 b2 / a2) */
+  uint64_t v2 = tq;                   /* v^2 << 8 (v integer) */
+  uint32_t u = 0, v = B, f, a;
+  int32_t  su, sv;
+  dq = (b2 << 8) / a2;
+  dr = (b2 << 8) % a2;
+  eq = (b2 << 9) / a2;
+  er = (b2 << 9) % a2;
+  while(b2 * u + Swap <= a2 * v)      /* until the 45 degree slope */
+  {
+    while(v2 > tq)                    /* v = floor(sqrt(v^2)) */
+    {
+      v2 -= (uint64_t)(2 * v - 1) << 8;
+      v--;
+    }
+    f = (uint32_t)(tq - v2) / (2 * v + 1);
+    a = AaCoverage[f >> 2];
+    for(uint32_t m = 0; m < 4; m++)
+    {
+      su = m & 1 ? -1 : 1;
+      sv = m & 2 ? -1 : 1;
+      if(su < 0 && !u)
+        continue;
+      if(Swap)
+        BlendPair(xc + sv * (int32_t)v, yc + su * (int32_t)u, xc + sv * (int32_t)(v + 1), yc + su * (int32_t)u, a);
+      else
+        BlendPair(xc + su * (int32_t)u, yc + sv * (int32_t)v, xc + su * (int32_t)u, yc + sv * (int32_t)(v + 1), a);
+    }
+    /* u + 1 */
+    tq -= dq;
+    if(tr < dr)
+    {
+      tr += a2;
+      tq--;
+    }
+    tr -= dr;
+    dq += eq;
+    dr += er;
+    if(dr >= a2)
+    {
+      dr -= a2;
+      dq++;
+    }
+    u++;
+  }
+}
 
 /**
   * @brief  Draws a character on LCD.
@@ -837,19 +3580,35 @@ void BSP_LCD_DisplayOff(void)
   */
 static void DrawChar(uint16_t Xpos, uint16_t Ypos, const uint8_t *pChar)
 {
-  uint32_t counterh = 0, counterw = 0;
+  uint32_t counterh = 0;
   uint16_t height = 0, width = 0;
-  uint8_t offset = 0;
   uint8_t *pchar = NULL;
   uint32_t line = 0;
-  int32_t ip;
+  int32_t ip, x = (int16_t)Xpos, y = (int16_t)Ypos;
+  int32_t w1 = 0, w2, h1 = 0, h2;     /* visible columns and rows of the character */
 
   height = DrawProp.pFont->Height;
   width  = DrawProp.pFont->Width;
+
+  /* clip (the invisible rows and columns are skipped) */
+  w2 = width;
+  h2 = height;
+  if(x < Clip.x1)
+    w1 = Clip.x1 - x;
+  if(x + w2 - 1 > Clip.x2)
+    w2 = Clip.x2 - x + 1;
+  if(y < Clip.y1)
+    h1 = Clip.y1 - y;
+  if(y + h2 - 1 > Clip.y2)
+    h2 = Clip.y2 - y + 1;
+  if(w1 >= w2 || h1 >= h2)
+    return;
+
+  LCD_SYNC();
+  DIRTY_RECT(x + w1, y + h1, w2 - w1, h2 - h1);
+  GlyphLutUpdate();
   
-  offset =  8 *((width + 7)/8) - width ;
-  
-  for(counterh = 0; counterh < height; counterh++)
+  for(counterh = h1; counterh < h2; counterh++)
   {
     pchar = ((uint8_t *)pChar + (width + 7)/8 * counterh);
     
@@ -868,21 +3627,131 @@ static void DrawChar(uint16_t Xpos, uint16_t Ypos, const uint8_t *pChar)
       line =  pchar[0];
     }    
     
-    ip = fb.SizeX * (Ypos + counterh) + Xpos;
+    ip = fb.Stride * (y + counterh) + x + w1;
+
+    /* the first visible column to the MSB */
+    GlyphRow((PIXELVAL *)&fb.pixels[ip], line << (32 - 8 * ((width + 7)/8) + w1), w2 - w1);
+  }
+}
+
+/**
+  * @brief  Draws characters on LCD (the rows of the consecutive glyphs are drawn at once).
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  Text: Pointer to the characters
+  * @param  Count: Number of characters
+  * @retval None
+  */
+static void DrawString(int32_t Xpos, int32_t Ypos, const uint8_t *Text, uint32_t Count)
+{
+  sFONT    *pFont = DrawProp.pFont;
+  uint32_t width = pFont->Width, bytes = (pFont->Width + 7) / 8;
+  uint32_t size = pFont->Height * bytes;
+  int32_t  h1 = 0, h2 = pFont->Height;
+  uint32_t i, n, nb, row;
+  uint64_t acc;
+  const uint8_t *pchar;
+  PIXELVAL *p;
+
+  /* not fully visible horizontally (or empty): character by character (DrawChar clips) */
+  if(!Count || Xpos < Clip.x1 || Xpos + (int32_t)(Count * width) - 1 > Clip.x2)
+  {
+    for(i = 0; i < Count; i++)
+      DrawChar(Xpos + i * width, Ypos, &pFont->table[(Text[i] - ' ') * size]);
+    return;
+  }
+  if(Ypos < Clip.y1)
+    h1 = Clip.y1 - Ypos;
+  if(Ypos + h2 - 1 > Clip.y2)
+    h2 = Clip.y2 - Ypos + 1;
+  if(h1 >= h2)
+    return;
 
-    for (counterw = 0; counterw < width; counterw++)
+  LCD_SYNC();
+  DIRTY_RECT(Xpos, Ypos + h1, Count * width, h2 - h1);
+  GlyphLutUpdate();
+
+  for(row = h1; row < h2; row++)
+  {
+    p = (PIXELVAL *)&fb.pixels[fb.Stride * (Ypos + row) + Xpos];
+    acc = 0;                          /* glyph row bits (the last nb bits are valid) */
+    nb = 0;
+    for(i = 0; i < Count; i++)
     {
-      if(line & (1 << (width- counterw + offset- 1))) 
+      pchar = &pFont->table[(Text[i] - ' ') * size + row * bytes];
+      acc = acc << width | (bytes == 1 ? pchar[0] : bytes == 2 ? (pchar[0] << 8 | pchar[1]) :
+                                         (pchar[0] << 16 | pchar[1] << 8 | pchar[2])) >> (8 * bytes - width);
+      nb += width;
+      if(nb >= 12)                    /* the whole nibbles */
       {
-        fb.pixels[ip] = DrawProp.TextColor;
-        ip++;
+        n = nb & ~3;
+        GlyphRow(p, (uint32_t)(acc >> (nb - n)) << (32 - n), n);
+        p += n;
+        nb -= n;
       }
-      else
+    }
+    if(nb)
+      GlyphRow(p, (uint32_t)acc << (32 - nb), nb);
+  }
+}
+
+/**
+  * @brief  Rebuilds the glyph lookup table if the text or back color is changed.
+  * @param  None
+  * @retval None
+  */
+static void GlyphLutUpdate(void)
+{
+  if(GlyphLutValid && GlyphLutFg == DrawProp.TextColor && GlyphLutBg == DrawProp.BackColor)
+    return;
+  GlyphLutFg = DrawProp.TextColor;
+  GlyphLutBg = DrawProp.BackColor;
+  GlyphLutValid = 1;
+  for(uint32_t n = 0; n < 16; n++)
+    for(uint32_t k = 0; k < 4; k++)
+      LCD_PIXEL_WR(&GlyphLut[n].c[k], n & (8 >> k) ? GlyphLutFg : GlyphLutBg);
+}
+
+/**
+  * @brief  Draws a glyph row.
+  *         opaque: 4 pixels / lookup table entry, transparent: only the text color runs
+  * @param  p: Pointer to the first pixel
+  * @param  Bits: Glyph row bits (the first pixel is the MSB)
+  * @param  Length: Number of pixels (max 31)
+  * @retval None
+  */
+static void GlyphRow(PIXELVAL *p, uint32_t Bits, uint32_t Length)
+{
+  uint32_t s, r;
+  if(DrawProp.TextMode == LCD_TEXT_TRANSPARENT)
+  {
+    Bits &= ~(0xFFFFFFFFu >> Length);
+    while(Bits)
+    {
+      s = __builtin_clz(Bits);        /* background pixels */
+      Bits <<= s;
+      p += s;
+      r = __builtin_clz(~Bits);       /* text color run */
+      Bits <<= r;
+      while(r--)
       {
-        fb.pixels[ip] = DrawProp.BackColor;
-        ip++;
-      } 
+        LCD_PIXEL_WR(p, DrawProp.TextColor);
+        p++;
+      }
     }
+    return;
+  }
+  for(; Length >= 4; Length -= 4)
+  {
+    *(GlyphQuadTypeDef *)p = GlyphLut[Bits >> 28];
+    p += 4;
+    Bits <<= 4;
+  }
+  for(; Length; Length--)
+  {
+    LCD_PIXEL_WR(p, (int32_t)Bits < 0 ? DrawProp.TextColor : DrawProp.BackColor);
+    p++;
+    Bits <<= 1;
   }
 }
 
@@ -897,9 +3766,10 @@ static void DrawChar(uint16_t Xpos, uint16_t Ypos, const uint8_t *pChar)
   * @param  y3: Point 3 Y position
   * @retval None
   */
-void BSP_LCD_FillTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t x3, uint16_t y3)
+void BSP_LCD_FillTriangle(uint16_t X1, uint16_t Y1, uint16_t X2, uint16_t Y2, uint16_t X3, uint16_t Y3)
 {
   int16_t a, b, y, last;
+  int16_t x1 = X1, y1 = Y1, x2 = X2, y2 = Y2, x3 = X3, y3 = Y3;
 
   // Sort coordinates by Y order (y3 >= y2 >= y1)
   if (y1 > y2)
@@ -913,6 +3783,12 @@ void BSP_LCD_FillTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, ui
     SWAP16(y1, y2); SWAP16(x1, x2);
   }
 
+  /* trivial reject */
+  if(y1 > Clip.y2 || y3 < Clip.y1 ||
+     (x1 < Clip.x1 && x2 < Clip.x1 && x3 < Clip.x1) ||
+     (x1 > Clip.x2 && x2 > Clip.x2 && x3 > Clip.x2))
+    return;
+
   if(y1 == y3)
   { // Handle awkward all-on-same-line case as its own thing
     a = b = x1;
@@ -924,50 +3800,52 @@ void BSP_LCD_FillTriangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, ui
     return;
   }
 
-  int16_t
-  dx12 = x2 - x1,
-  dy12 = y2 - y1,
-  dx13 = x3 - x1,
-  dy13 = y3 - y1,
-  dx23 = x3 - x2,
-  dy23 = y3 - y2;
-  int32_t
-  sa   = 0,
-  sb   = 0;
+  TriEdgeTypeDef ea, eb;
 
   // For upper part of triangle, find scanline crossings for segments
   // 1-2 and 1-3.  If y2=y3 (flat-bottomed triangle), the scanline y2
-  // is included here (and second loop will be skipped, avoiding a /0
-  // error there), otherwise scanline y2 is skipped here and handled
-  // in the second loop...which also avoids a /0 error here if y1=y2
-  // (flat-topped triangle).
+  // is included here (and second loop will be skipped), otherwise
+  // scanline y2 is skipped here and handled in the second loop
+  // (which also avoids the 1-2 edge if y1=y2, flat-topped triangle).
+  // The crossings are stepped without division (see TriEdgeStep).
   if(y2 == y3) last = y2;   // Include y2 scanline
   else         last = y2 - 1; // Skip it
 
-  for(y = y1; y <= last; y++)
+  // Clip: the lines above and below the clip rectangle are skipped
+  y = y1 < Clip.y1 ? Clip.y1 : y1;
+  if(last > Clip.y2) last = Clip.y2;
+  TriEdgeInit(&eb, x1, x3 - x1, y3 - y1, y - y1);
+  if(y <= last)
   {
-    a   = x1 + sa / dy12;
-    b   = x1 + sb / dy13;
-    sa += dx12;
-    sb += dx13;
-    /* longhand:
-    a = x1 + (x2 - x1) * (y - y1) / (y2 - y1);
-    b = x1 + (x3 - x1) * (y - y2) / (y3 - y1);
-    */
-    if(a > b) SWAP16(a, b);
-    BSP_LCD_DrawHLine(a, y, b - a + 1);
+    TriEdgeInit(&ea, x1, x2 - x1, y2 - y1, y - y1);
+    for(; y <= last; y++)
+    {
+      a = ea.x;
+      b = eb.x;
+      TriEdgeStep(&ea);
+      TriEdgeStep(&eb);
+      /* longhand:
+      a = x1 + (x2 - x1) * (y - y1) / (y2 - y1);
+      b = x1 + (x3 - x1) * (y - y1) / (y3 - y1);
+      */
+      if(a > b) SWAP16(a, b);
+      BSP_LCD_DrawHLine(a, y, b - a + 1);
+    }
   }
 
   // For lower part of triangle, find scanline crossings for segments
   // 1-3 and 2-3.  This loop is skipped if y1=y2.
-  sa = (int32_t)dx23 * (y - y2);
-  sb = (int32_t)dx13 * (y - y1);
-  for(; y <= y3; y++)
-  {
-    a   = x2 + sa / dy23;
-    b   = x1 + sb / dy13;
-    sa += dx23;
-    sb += dx13;
+  // (the 1-3 edge goes on from the upper part)
+  last = y3 > Clip.y2 ? Clip.y2 : y3;
+  if(y > last)
+    return;
+  TriEdgeInit(&ea, x2, x3 - x2, y3 - y2, y - y2);
+  for(; y <= last; y++)
+  {
+    a = ea.x;
+    b = eb.x;
+    TriEdgeStep(&ea);
+    TriEdgeStep(&eb);
     /* longhand:
     a = x2 + (x3 - x2) * (y - y2) / (y3 - y2);
     b = x1 + (x3 - x1) * (y - y1) / (y3 - y1);
@@ -985,34 +3863,83 @@ uint16_t BSP_LCD_ReadID(void)
 
 COLORVAL BSP_LCD_ReadPixel(uint16_t Xpos, uint16_t Ypos)
 {
-  return fb.pixels[fb.SizeX * Ypos + Xpos];
+  LCD_SYNC();
+  return LCD_PIXEL_RD(&fb.pixels[fb.Stride * Ypos + Xpos]);
 }
 
 void BSP_LCD_DrawRGB16Image(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16_t Ysize, uint16_t *pData)
 {
   int32_t ip, ih;
   uint16_t cv16;
+  int32_t x = (int16_t)Xpos, y = (int16_t)Ypos, w = Xsize, h = Ysize, top = 0;
+
+  /* clip: x, y, w, h = the visible part, pData = the first visible source pixel */
+  if(x < Clip.x1)
+  {
+    pData += Clip.x1 - x;
+    w -= Clip.x1 - x;
+    x = Clip.x1;
+  }
+  if(x + w - 1 > Clip.x2)
+    w = Clip.x2 - x + 1;
+  if(y < Clip.y1)
+  {
+    top = Clip.y1 - y;
+    h -= top;
+    y = Clip.y1;
+  }
+  if(y + h - 1 > Clip.y2)
+    h = Clip.y2 - y + 1;
+  if(w <= 0 || h <= 0)
+    return;
+  if(BitmapDrawDir == RIGHT_THEN_DOWN)
+    pData += top * Xsize;
+  else                                /* the first source line is the lowest visible line */
+    pData += (Ysize - top - h) * Xsize;
+  DIRTY_RECT(x, y, w, h);
+
+  #if LCD_DMA2D > 0
+  if(w * h >= LCD_DMA2D_MINPIXELS && DMA2D_ADDRESSABLE(pData) && DMA2D_ADDRESSABLE(fb.pixels))
+  {
+    PIXELVAL *p = (PIXELVAL *)&fb.pixels[fb.Stride * y + x];
+    if(BitmapDrawDir == RIGHT_THEN_DOWN)
+      Dma2d_Copy(pData, Xsize - w, DMA2D_CM_RGB565, p, fb.Stride - w, w, h);
+    else
+    { /* the DMA2D can not step backward: bottom up images go line by line */
+      p += fb.Stride * (h - 1);
+      while(h--)
+      {
+        Dma2d_Copy(pData, 0, DMA2D_CM_RGB565, p, 0, w, 1);
+        pData += Xsize;
+        p -= fb.Stride;
+      }
+    }
+    return;
+  }
+  LCD_SYNC();
+  #endif
   if(BitmapDrawDir == RIGHT_THEN_DOWN)
   {
-    ip = fb.SizeX * Ypos + Xpos;
-    ih = fb.SizeX - Xsize;
+    ip = fb.Stride * y + x;
+    ih = fb.Stride - w;
   }
   else /* if(BitmapDrawDir == RIGHT_THEN_UP) */
   {
-    ip = fb.SizeX * (Ypos + Ysize - 1) + Xpos;
-    ih = 0 - (fb.SizeX + Xsize);
+    ip = fb.Stride * (y + h - 1) + x;
+    ih = 0 - (fb.Stride + w);
   }
 
-  while(Ysize--)
+  while(h--)
   {
-    int32_t iw = Xsize;
+    int32_t iw = w;
     while(iw--)
     {
       cv16 = *pData;
-      fb.pixels[ip] = LCD_COLOR_FROM_RGB565(cv16);
+      LCD_PIXEL_WR(&fb.pixels[ip], LCD_COLOR_FROM_RGB565(cv16));
       ip++;
       pData++;
     }
+    pData += Xsize - w;
     ip += ih;
   }
 }
@@ -1021,15 +3948,16 @@ void BSP_LCD_ReadRGB16Image(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16
 {
   int32_t ip, ih;
   COLORVAL cv;
+  LCD_SYNC();
   if(BitmapDrawDir == RIGHT_THEN_DOWN)
   {
-    ip = fb.SizeX * Ypos + Xpos;
-    ih = fb.SizeX - Xsize;
+    ip = fb.Stride * Ypos + Xpos;
+    ih = fb.Stride - Xsize;
   }
   else /* if(BitmapDrawDir == RIGHT_THEN_UP) */
   {
-    ip = fb.SizeX * (Ypos + Ysize - 1) + Xpos;
-    ih = 0 - (fb.SizeX + Xsize);
+    ip = fb.Stride * (Ypos + Ysize - 1) + Xpos;
+    ih = 0 - (fb.Stride + Xsize);
   }
 
   while(Ysize--)
@@ -1037,7 +3965,7 @@ void BSP_LCD_ReadRGB16Image(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16
     int32_t iw = Xsize;
     while(iw--)
     {
-      cv = fb.pixels[ip];
+      cv = LCD_PIXEL_RD(&fb.pixels[ip]);
       *pData = LCD_COLOR_TO_RGB565(cv);
       ip++;
       pData++;
@@ -1046,6 +3974,90 @@ void BSP_LCD_ReadRGB16Image(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16
   }
 }
 
+/**
+  * @brief  Draws a packed RGB888 image (3 bytes/pixel: B, G, R byte order, the DMA2D RGB888 format).
+  * @param  Xpos: X position
+  * @param  Ypos: Y position
+  * @param  Xsize: Image width
+  * @param  Ysize: Image height
+  * @param  pData: Pointer to the image
+  * @retval None
+  */
+void BSP_LCD_DrawRGB24Image(uint16_t Xpos, uint16_t Ypos, uint16_t Xsize, uint16_t Ysize, uint8_t *pData)
+{
+  int32_t ip, ih;
+  int32_t x = (int16_t)Xpos, y = (int16_t)Ypos, w = Xsize, h = Ysize, top = 0;
+
+  /* clip: x, y, w, h = the visible part, pData = the first visible source pixel */
+  if(x < Clip.x1)
+  {
+    pData += (Clip.x1 - x) * 3;
+    w -= Clip.x1 - x;
+    x = Clip.x1;
+  }
+  if(x + w - 1 > Clip.x2)
+    w = Clip.x2 - x + 1;
+  if(y < Clip.y1)
+  {
+    top = Clip.y1 - y;
+    h -= top;
+    y = Clip.y1;
+  }
+  if(y + h - 1 > Clip.y2)
+    h = Clip.y2 - y + 1;
+  if(w <= 0 || h <= 0)
+    return;
+  if(BitmapDrawDir == RIGHT_THEN_DOWN)
+    pData += top * Xsize * 3;
+  else                                /* the first source line is the lowest visible line */
+    pData += (Ysize - top - h) * Xsize * 3;
+  DIRTY_RECT(x, y, w, h);
+
+  #if LCD_DMA2D > 0
+  if(w * h >= LCD_DMA2D_MINPIXELS && DMA2D_ADDRESSABLE(pData) && DMA2D_ADDRESSABLE(fb.pixels))
+  {
+    PIXELVAL *p = (PIXELVAL *)&fb.pixels[fb.Stride * y + x];
+    if(BitmapDrawDir == RIGHT_THEN_DOWN)
+      Dma2d_Copy(pData, Xsize - w, DMA2D_CM_RGB888, p, fb.Stride - w, w, h);
+    else
+    { /* the DMA2D can not step backward: bottom up images go line by line */
+      p += fb.Stride * (h - 1);
+      while(h--)
+      {
+        Dma2d_Copy(pData, 0, DMA2D_CM_RGB888, p, 0, w, 1);
+        pData += Xsize * 3;
+        p -= fb.Stride;
+      }
+    }
+    return;
+  }
+  LCD_SYNC();
+  #endif
+  if(BitmapDrawDir == RIGHT_THEN_DOWN)
+  {
+    ip = fb.Stride * y + x;
+    ih = fb.Stride - w;
+  }
+  else /* if(BitmapDrawDir == RIGHT_THEN_UP) */
+  {
+    ip = fb.Stride * (y + h - 1) + x;
+    ih = 0 - (fb.Stride + w);
+  }
+
+  while(h--)
+  {
+    int32_t iw = w;
+    while(iw--)
+    {
+      LCD_PIXEL_WR(&fb.pixels[ip], LCD_COLOR(pData[2], pData[1], pData[0]));
+      ip++;
+      pData += 3;
+    }
+    pData += (Xsize - w) * 3;
+    ip += ih;
+  }
+}
+
 #endif  /* #ifdef   LCD_DRVTYPE_V1_1 */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
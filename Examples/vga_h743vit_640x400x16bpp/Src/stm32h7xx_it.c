@@ -36,7 +36,7 @@
 #include "stm32h7xx_it.h"
 
 /* USER CODE BEGIN 0 */
-
+void BSP_LCD_LineEvent(void);
 /* USER CODE END 0 */
 
 /* External variables --------------------------------------------------------*/
@@ -223,5 +223,13 @@ void TIM7_IRQHandler(void)
 
 /* USER CODE BEGIN 1 */
 
+/**
+* @brief This function handles LTDC global interrupt (line interrupt of the LCD_LINEDOUBLE and LCD_STRIPS modes).
+*/
+void LTDC_IRQHandler(void)
+{
+  BSP_LCD_LineEvent();
+}
+
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/